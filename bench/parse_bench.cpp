@@ -0,0 +1,425 @@
+/**
+ * Measures the text publish parser, in bytes per second, on a stream of mixed message sizes fed in receive buffer sized
+ * chunks. Three versions are compared:
+ *  - byte loop: the original parser, one character at a time, building each message in strings
+ *  - findChar: the same, with the delimiters found by utils::findChar and each field appended as a span
+ *  - in place: the current parser, which writes each field straight into the batch as it is scanned
+ *
+ * Build with -DCMAKE_CXX_FLAGS=-mavx2 to measure the AVX2 scan, the default is SSE2 on x86-64.
+ * Usage: parse_bench [megabytes of messages] [rounds]
+ */
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../server/MessageBatch.hpp"
+#include "../server/StringUtils.hpp"
+
+using namespace gazellemq::server;
+
+namespace {
+    /**
+     * Stands in for the message bus, it only counts what it is given
+     */
+    struct Sink {
+        size_t nbBatches{};
+        size_t nbMessages{};
+        size_t nbBytes{};
+
+        void push(MessageBatch&& batch) {
+            ++nbBatches;
+            nbMessages += batch.getNbMessages();
+            nbBytes += batch.getBufferLength();
+        }
+    };
+
+    enum ParseState {
+        ParseState_messageType,
+        ParseState_messageContentLength,
+        ParseState_messageContent,
+    };
+
+    /**
+     * The parser before delimiters were scanned for, and before messages were parsed in place
+     */
+    class ByteLoopParser {
+    private:
+        Sink& sink;
+        MessageBatch currentBatch{};
+        std::string messageType;
+        std::string messageLengthBuffer;
+        std::string messageContent;
+        std::string lastMessageType;
+        MessageTypeId lastMessageTypeId{NO_MESSAGE_TYPE};
+        size_t messageContentLength{};
+        size_t nbContentBytesRead{};
+        ParseState parseState{};
+    public:
+        explicit ByteLoopParser(Sink& sink)
+            : sink(sink)
+        {}
+
+        void parse(char const* buffer, size_t bufferLength) {
+            for (size_t i{0}; i < bufferLength; ++i) {
+                char const ch{buffer[i]};
+                if (parseState == ParseState_messageType) {
+                    if (ch == '|') {
+                        parseState = ParseState_messageContentLength;
+                    } else {
+                        messageType.push_back(ch);
+                    }
+                } else if (parseState == ParseState_messageContentLength) {
+                    if (ch == '|') {
+                        messageContentLength = std::stoul(messageLengthBuffer);
+                        parseState = ParseState_messageContent;
+                    } else {
+                        messageLengthBuffer.push_back(ch);
+                    }
+                } else {
+                    size_t const nbCharsNeeded{std::min(messageContentLength - nbContentBytesRead, bufferLength - i)};
+                    messageContent.append(&buffer[i], nbCharsNeeded);
+                    nbContentBytesRead += nbCharsNeeded;
+                    i += nbCharsNeeded - 1;
+
+                    if (messageContentLength == nbContentBytesRead) {
+                        onMessageParsed();
+                    }
+                }
+            }
+            flush();
+        }
+
+        void flush() {
+            if (currentBatch.getNbMessages() > 0) {
+                sink.push(std::move(currentBatch));
+                currentBatch.clearForNextMessage();
+            }
+        }
+    private:
+        void onMessageParsed() {
+            std::string message{};
+            message.append(messageType);
+            message.push_back('|');
+            message.append(messageLengthBuffer);
+            message.push_back('|');
+            message.append(messageContent);
+
+            if (lastMessageTypeId == NO_MESSAGE_TYPE || messageType != lastMessageType) {
+                lastMessageTypeId = getMessageTypes().intern(messageType);
+                lastMessageType = messageType;
+            }
+
+            if (currentBatch.getMessageType() != lastMessageTypeId) {
+                flush();
+                currentBatch.setMessageType(lastMessageTypeId);
+            }
+
+            // append() only takes the message when it fits
+            if (!currentBatch.append(std::move(message))) {
+                flush();
+                currentBatch.setMessageType(lastMessageTypeId);
+                currentBatch.append(std::move(message));
+            }
+
+            messageContentLength = 0;
+            nbContentBytesRead = 0;
+            messageLengthBuffer.clear();
+            messageType.clear();
+            messageContent.clear();
+            parseState = ParseState_messageType;
+        }
+    };
+
+    /**
+     * The byte loop with the delimiters found by utils::findChar
+     */
+    class FindCharParser {
+    private:
+        Sink& sink;
+        MessageBatch currentBatch{};
+        std::string messageType;
+        std::string messageLengthBuffer;
+        std::string messageContent;
+        std::string lastMessageType;
+        MessageTypeId lastMessageTypeId{NO_MESSAGE_TYPE};
+        size_t messageContentLength{};
+        size_t nbContentBytesRead{};
+        ParseState parseState{};
+    public:
+        explicit FindCharParser(Sink& sink)
+            : sink(sink)
+        {}
+
+        void parse(char const* buffer, size_t bufferLength) {
+            size_t i{0};
+            while (i < bufferLength) {
+                if (parseState == ParseState_messageContent) {
+                    size_t const nbCharsNeeded{std::min(messageContentLength - nbContentBytesRead, bufferLength - i)};
+                    messageContent.append(&buffer[i], nbCharsNeeded);
+                    nbContentBytesRead += nbCharsNeeded;
+                    i += nbCharsNeeded;
+                } else {
+                    std::string& field{parseState == ParseState_messageType ? messageType : messageLengthBuffer};
+                    size_t const nbChars{gazellemq::utils::findChar(&buffer[i], bufferLength - i, '|')};
+                    field.append(&buffer[i], nbChars);
+                    i += nbChars;
+                    if (i == bufferLength) {
+                        break;
+                    }
+
+                    ++i;
+                    if (parseState == ParseState_messageType) {
+                        parseState = ParseState_messageContentLength;
+                        continue;
+                    }
+
+                    char const* lengthEnd{messageLengthBuffer.data() + messageLengthBuffer.size()};
+                    std::from_chars(messageLengthBuffer.data(), lengthEnd, messageContentLength);
+                    parseState = ParseState_messageContent;
+                }
+
+                if (messageContentLength == nbContentBytesRead) {
+                    onMessageParsed();
+                }
+            }
+            flush();
+        }
+
+        void flush() {
+            if (currentBatch.getNbMessages() > 0) {
+                sink.push(std::move(currentBatch));
+                currentBatch.clearForNextMessage();
+            }
+        }
+    private:
+        void onMessageParsed() {
+            std::string message{};
+            message.append(messageType);
+            message.push_back('|');
+            message.append(messageLengthBuffer);
+            message.push_back('|');
+            message.append(messageContent);
+
+            if (lastMessageTypeId == NO_MESSAGE_TYPE || messageType != lastMessageType) {
+                lastMessageTypeId = getMessageTypes().intern(messageType);
+                lastMessageType = messageType;
+            }
+
+            if (currentBatch.getMessageType() != lastMessageTypeId) {
+                flush();
+                currentBatch.setMessageType(lastMessageTypeId);
+            }
+
+            // append() only takes the message when it fits
+            if (!currentBatch.append(std::move(message))) {
+                flush();
+                currentBatch.setMessageType(lastMessageTypeId);
+                currentBatch.append(std::move(message));
+            }
+
+            messageContentLength = 0;
+            nbContentBytesRead = 0;
+            messageLengthBuffer.clear();
+            messageType.clear();
+            messageContent.clear();
+            parseState = ParseState_messageType;
+        }
+    };
+
+    /**
+     * The current parser, every field is written to the batch as it is scanned. Like TCPPublisherHandler with one
+     * open batch and no linger time.
+     */
+    class InPlaceParser {
+    private:
+        Sink& sink;
+        MessageBatch currentBatch{};
+        size_t messageOffset{};
+        size_t lengthOffset{};
+        std::string lastMessageType;
+        MessageTypeId lastMessageTypeId{NO_MESSAGE_TYPE};
+        size_t messageContentLength{};
+        size_t nbContentBytesRead{};
+        ParseState parseState{};
+    public:
+        explicit InPlaceParser(Sink& sink)
+            : sink(sink)
+        {
+            currentBatch.reserve(2 * DEFAULT_BATCH_MAX_BYTES);
+        }
+
+        void parse(char const* buffer, size_t bufferLength) {
+            size_t i{0};
+            while (i < bufferLength) {
+                if (parseState == ParseState_messageContent) {
+                    size_t const nbCharsNeeded{std::min(messageContentLength - nbContentBytesRead, bufferLength - i)};
+                    currentBatch.appendRaw(&buffer[i], nbCharsNeeded);
+                    nbContentBytesRead += nbCharsNeeded;
+                    i += nbCharsNeeded;
+                } else {
+                    size_t const nbChars{gazellemq::utils::findChar(&buffer[i], bufferLength - i, '|')};
+                    if (i + nbChars == bufferLength) {
+                        currentBatch.appendRaw(&buffer[i], nbChars);
+                        break;
+                    }
+
+                    currentBatch.appendRaw(&buffer[i], nbChars + 1);
+                    i += nbChars + 1;
+                    if (parseState == ParseState_messageType) {
+                        onMessageTypeParsed();
+                        continue;
+                    }
+
+                    char const* lengthStart{&currentBatch.getBuffer()[lengthOffset]};
+                    char const* lengthEnd{&currentBatch.getBuffer()[currentBatch.getBufferLength() - 1]};
+                    std::from_chars(lengthStart, lengthEnd, messageContentLength);
+                    parseState = ParseState_messageContent;
+                }
+
+                if (messageContentLength == nbContentBytesRead) {
+                    onMessageParsed();
+                }
+            }
+            flushCompleteMessages();
+        }
+    private:
+        void onMessageTypeParsed() {
+            std::string_view const messageType{&currentBatch.getBuffer()[messageOffset], currentBatch.getBufferLength() - messageOffset - 1};
+            if (lastMessageTypeId == NO_MESSAGE_TYPE || messageType != lastMessageType) {
+                lastMessageTypeId = getMessageTypes().intern(messageType);
+                lastMessageType = messageType;
+            }
+
+            if (currentBatch.getMessageType() != lastMessageTypeId) {
+                flushCompleteMessages();
+                currentBatch.setMessageType(lastMessageTypeId);
+            }
+
+            lengthOffset = currentBatch.getBufferLength();
+            parseState = ParseState_messageContentLength;
+        }
+
+        void onMessageParsed() {
+            currentBatch.endMessage(messageOffset);
+            messageOffset = currentBatch.getBufferLength();
+            messageContentLength = 0;
+            nbContentBytesRead = 0;
+            parseState = ParseState_messageType;
+
+            if (currentBatch.getBufferLength() >= DEFAULT_BATCH_MAX_BYTES || currentBatch.getNbMessages() >= DEFAULT_BATCH_MAX_MESSAGES) {
+                flushCompleteMessages();
+            }
+        }
+
+        /**
+         * Sends the complete messages, the partial one moves to the start of a new batch
+         */
+        void flushCompleteMessages() {
+            if (currentBatch.getNbMessages() == 0) {
+                return;
+            }
+
+            MessageBatch next{};
+            next.reserve(2 * DEFAULT_BATCH_MAX_BYTES);
+            if (messageOffset < currentBatch.getBufferLength()) {
+                next.appendRaw(&currentBatch.getBuffer()[messageOffset], currentBatch.getBufferLength() - messageOffset);
+                if (parseState != ParseState_messageType) {
+                    next.setMessageType(currentBatch.getMessageType());
+                    lengthOffset -= messageOffset;
+                }
+                currentBatch.truncate(messageOffset);
+            }
+
+            sink.push(std::move(currentBatch));
+            currentBatch = std::move(next);
+            messageOffset = 0;
+        }
+    };
+
+    /**
+     * Returns messages of a few types, with content lengths spread from a few bytes to 16 KiB, mostly small
+     * @param nbBytes
+     * @param nbMessages Set to the number of messages
+     * @return
+     */
+    std::string makeMessages(size_t nbBytes, size_t& nbMessages) {
+        static constexpr size_t CONTENT_LENGTHS[]{8, 24, 64, 100, 256, 700, 1500, 4096, 16384};
+        static constexpr unsigned int WEIGHTS[]{20, 20, 20, 12, 10, 8, 5, 3, 2};
+        static char const* const TYPES[]{"prices", "orders.new", "orders.fill", "trades", "heartbeat", "book.l2"};
+
+        std::mt19937 random{42};
+        std::discrete_distribution<size_t> lengthIndex{std::begin(WEIGHTS), std::end(WEIGHTS)};
+        std::uniform_int_distribution<size_t> typeIndex{0, std::size(TYPES) - 1};
+
+        std::string retVal;
+        retVal.reserve(nbBytes + 32768);
+        nbMessages = 0;
+        while (retVal.size() < nbBytes) {
+            size_t const contentLength{CONTENT_LENGTHS[lengthIndex(random)]};
+
+            // types come in runs, like publishers that send bursts of one type
+            std::string const type{TYPES[typeIndex(random)]};
+            size_t const runLength{1 + random() % 8};
+            for (size_t i{}; i < runLength; ++i) {
+                retVal.append(type);
+                retVal.push_back('|');
+                retVal.append(std::to_string(contentLength));
+                retVal.push_back('|');
+                retVal.append(contentLength, static_cast<char>('a' + i));
+                ++nbMessages;
+            }
+        }
+        return retVal;
+    }
+
+    /**
+     * Feeds the messages to the parser in receive buffer sized chunks and prints its throughput
+     * @param name
+     * @param messages
+     * @param nbMessages
+     * @param nbRounds
+     */
+    template<typename Parser>
+    void run(char const* name, std::string const& messages, size_t nbMessages, int nbRounds) {
+        double bestSeconds{};
+        for (int round{}; round < nbRounds; ++round) {
+            Sink sink{};
+            Parser parser{sink};
+
+            auto const start{std::chrono::steady_clock::now()};
+            for (size_t i{}; i < messages.size(); i += MAX_READ_BUF) {
+                parser.parse(&messages[i], std::min<size_t>(MAX_READ_BUF, messages.size() - i));
+            }
+            double const seconds{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+
+            if (sink.nbMessages != nbMessages || sink.nbBytes != messages.size()) {
+                printf("%s: parsed %zu messages and %zu bytes, expected %zu and %zu\n", name, sink.nbMessages, sink.nbBytes, nbMessages, messages.size());
+                exit(1);
+            }
+
+            if (round == 0 || seconds < bestSeconds) {
+                bestSeconds = seconds;
+            }
+        }
+
+        printf("%-10s %10.1f MB/s %12.1f M msgs/s\n", name, static_cast<double>(messages.size()) / bestSeconds / 1e6, static_cast<double>(nbMessages) / bestSeconds / 1e6);
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t const nbMegabytes{argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256};
+    int const nbRounds{argc > 2 ? std::atoi(argv[2]) : 5};
+
+    size_t nbMessages{};
+    std::string const messages{makeMessages(nbMegabytes * 1048576, nbMessages)};
+    printf("%zu messages, %zu bytes, best of %d rounds\n", nbMessages, messages.size(), nbRounds);
+
+    run<ByteLoopParser>("byte loop", messages, nbMessages, nbRounds);
+    run<FindCharParser>("findChar", messages, nbMessages, nbRounds);
+    run<InPlaceParser>("in place", messages, nbMessages, nbRounds);
+    return 0;
+}
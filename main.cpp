@@ -1,8 +1,10 @@
 #include <latch>
 
 #include "server/command/CommandServer.hpp"
-#include "server/subscriber/SubscriberServer.hpp"
-#include "server/publisher/PublisherServer.hpp"
+#include "server/subscriber/ShardedSubscriberServer.hpp"
+#include "server/publisher/ShardedPublisherServer.hpp"
+#include "server/ServerOptions.hpp"
+#include "server/log/MessageLog.hpp"
 
 using namespace gazellemq::server;
 
@@ -37,15 +39,38 @@ int main() {
     handleSignal(SIGTERM);
 
     ServerContext serverContext;
+    ServerOptions const options{ServerOptions::fromEnvironment()};
+    serverContext.setDefaultSlowConsumerPolicy(options.slowConsumerPolicy);
+    getMessageQueueOptions() = options.messageQueue;
 
-    SubscriberServer subscriberServer{5875, &serverContext, isRunning, [](int res, ServerContext* context) {
+    std::unique_ptr<MessageLog> messageLog;
+    if (!options.logDir.empty()) {
+        messageLog = std::make_unique<MessageLog>(options.logDir, options.logSegmentSize, isRunning);
+        if (options.logDurable) {
+            messageLog->setDurable(std::chrono::microseconds{options.logCommitUs}, options.logCommitBytes);
+        }
+        serverContext.setMessageLog(messageLog.get());
+        messageLog->start();
+    }
+
+    ShardedSubscriberServer subscriberServer{5875, options.nbSubscriberThreads, &serverContext, isRunning, [](int res, ServerContext* context) {
         return new TCPSubscriberHandler{res, context};
     }};
+    subscriberServer.setRingOptions(options.ring);
+    subscriberServer.setZeroCopyThreshold(options.zeroCopyThreshold);
+    subscriberServer.setSubscriberQueueDepth(options.subscriberQueueDepth);
     subscriberServer.start();
 
-    PublisherServer publisherServer{5876, &serverContext, isRunning, [](int res, ServerContext* context) {
+    ShardedPublisherServer publisherServer{5876, options.nbPublisherThreads, &serverContext, isRunning, [](int res, ServerContext* context) {
         return new TCPPublisherHandler{res, context};
     }};
+    RingOptions publisherRing{options.ring};
+    if (publisherRing.sqThreadCpu >= 0) {
+        // the publisher loops' polling threads take the CPUs after the subscriber loops'
+        publisherRing.sqThreadCpu += static_cast<int>(options.nbSubscriberThreads);
+    }
+    publisherServer.setRingOptions(publisherRing);
+    publisherServer.setBatchPolicy(options.batch);
     publisherServer.start();
 
     CommandServer commandServer{5877, &subscriberServer, &serverContext, isRunning, [](int res, ServerContext* context) {
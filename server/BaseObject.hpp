@@ -1,8 +1,14 @@
 #ifndef BASEOBJECT_HPP
 #define BASEOBJECT_HPP
 #include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
 #include <liburing.h>
 
+#include "Consts.hpp"
+
 namespace gazellemq::server {
     static std::atomic<int> g_id{0};
 
@@ -25,6 +31,60 @@ namespace gazellemq::server {
         }
 
         virtual void handleEvent (io_uring* ring, int res) = 0;
+
+        /**
+         * Returns a free sqe. The sqe is submitted with the rest of them once per event loop iteration, unless the
+         * submission queue fills up first.
+         * @param ring
+         * @return
+         */
+        static io_uring_sqe* getSqe(io_uring* ring) {
+            io_uring_sqe* sqe = io_uring_get_sqe(ring);
+            while (sqe == nullptr) {
+                io_uring_submit(ring);
+                sqe = io_uring_get_sqe(ring);
+            }
+            return sqe;
+        }
+
+        /**
+         * Submits every queued sqe, waits for at least one completion, then handles all the completions that are
+         * ready in one pass.
+         * @param ring
+         * @param ts how long to wait for a completion
+         */
+        static void processCompletions(io_uring* ring, __kernel_timespec& ts) {
+            io_uring_cqe* cqe{nullptr};
+            int const ret{io_uring_submit_and_wait_timeout(ring, &cqe, 1, &ts, nullptr)};
+            if (ret == -SIGILL || ret == TIMEOUT || ret == -EINTR) {
+                return;
+            }
+
+            if (ret < 0) {
+                printf("%s\n%s\n", "io_uring_submit_and_wait_timeout(...)", strerror(-ret));
+                return;
+            }
+
+            unsigned int head{};
+            unsigned int nbCqes{};
+            io_uring_for_each_cqe(ring, head, cqe) {
+                ++nbCqes;
+                if (cqe->res != -EAGAIN) {
+                    auto* pObject = static_cast<BaseObject*>(io_uring_cqe_get_data(cqe));
+                    pObject->handleCompletion(ring, cqe);
+                }
+            }
+            io_uring_cq_advance(ring, nbCqes);
+        }
+
+        /**
+         * Handles a completion. Override this when the completion flags are needed, not just the result.
+         * @param ring
+         * @param cqe
+         */
+        virtual void handleCompletion(io_uring* ring, io_uring_cqe const* cqe) {
+            handleEvent(ring, cqe->res);
+        }
     };
 }
 
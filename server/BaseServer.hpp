@@ -4,13 +4,16 @@
 #include <thread>
 #include <vector>
 #include <netinet/in.h>
-#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <algorithm>
+#include <chrono>
 #include <functional>
+#include <mutex>
 
 #include "BaseObject.hpp"
 #include "PubSubHandler.hpp"
 #include "Enums.hpp"
+#include "RingOptions.hpp"
 
 namespace gazellemq::server {
     class ServerContext;
@@ -21,12 +24,18 @@ namespace gazellemq::server {
 
         int fd{};
         int port;
-        int epfd{};
-        struct sockaddr_in clientAddr{};
-        socklen_t clientAddrLen = sizeof(clientAddr);
+        RingOptions ringOptions{};
+        bool reusePort{false};
+        bool useDirectDescriptors{false};
+        bool isAcceptArmed{false};
+
+        // when a failed accept is submitted again, time_point::max() when none failed
+        std::chrono::steady_clock::time_point acceptRetryAt{std::chrono::steady_clock::time_point::max()};
         std::vector<PubSubHandler*> clients{};
+
+        // only the loop's thread adds clients, other threads copy the list under this lock
+        std::mutex mClients;
         Enums::Event event{Enums::Event::Event_NotSet};
-        unsigned int maxEventBatch{8};
         std::jthread bgThread;
         ServerContext* serverContext{};
         std::atomic_flag& isRunning;
@@ -99,6 +108,10 @@ namespace gazellemq::server {
 
             int optVal = 1;
             setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optVal, sizeof(optVal));
+            if (reusePort) {
+                // lets several servers listen on the same port, the kernel spreads the connections between them
+                setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optVal, sizeof(optVal));
+            }
 
             // We bind to a port and turn this socket into a listening socket.
             int ret = bind(fd, (const struct sockaddr *) &srv_addr, sizeof(srv_addr));
@@ -107,55 +120,52 @@ namespace gazellemq::server {
                 exit(1);
             }
 
-            ret = listen(fd, 10);
+            ret = listen(fd, SOMAXCONN);
             if (ret < 0) {
                 printf("%s\n", "listen(...)");
                 exit(1);
             }
 
-            // set up polling of the inotify
-            epfd = epoll_create1(0);
-            if (epfd < 0) {
-                printf("%s\n", "epoll_create1(...)");
-                exit(1);
-            }
-
-
-            io_uring_sqe *sqe = io_uring_get_sqe(ring);
-            struct epoll_event ev{};
-            ev.events = EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLERR | EPOLLRDHUP;
-            ev.data.fd = fd;
-            io_uring_prep_epoll_ctl(sqe, epfd, fd, EPOLL_CTL_ADD, &ev);
-            io_uring_sqe_set_data(sqe, this);
-
-            event = Enums::Event::Event_SetupPublisherListeningSocket;
-            io_uring_submit(ring);
+            registerFiles(ring);
+            printHello();
+            beginAcceptConnection(ring);
         }
 
         /**
-         * Completes the setup event and goes to the accept event
-         * @param res
+         * Registers a sparse file table, so accepted connections can go straight into it as direct descriptors.
+         * Falls back to regular file descriptors when the kernel does not support it.
+         * @param ring
          */
-        void onSetupListeningSocketComplete(struct io_uring *ring, int res) {
-            if (res < 0) {
-                printError(__PRETTY_FUNCTION__, res);
+        void registerFiles(struct io_uring *ring) {
+            rlimit limit{};
+            getrlimit(RLIMIT_NOFILE, &limit);
+            auto const nbFiles{static_cast<unsigned int>(std::min<rlim_t>(DEFAULT_MAX_CONNECTIONS, limit.rlim_cur))};
+
+            int const ret{io_uring_register_files_sparse(ring, nbFiles)};
+            if (ret < 0) {
+                printError("io_uring_register_files_sparse(...), using regular file descriptors", ret);
+                useDirectDescriptors = false;
             } else {
-                printHello();
-                beginAcceptConnection(ring);
+                useDirectDescriptors = true;
             }
         }
 
         /**
-         * Submits an [accept] system call using liburing
+         * Submits a multishot [accept] system call using liburing. It keeps accepting connections until the kernel
+         * ends it.
          * @param ring
          */
         void beginAcceptConnection(struct io_uring *ring) {
-            io_uring_sqe *sqe = io_uring_get_sqe(ring);
-            io_uring_prep_accept(sqe, fd, (sockaddr *) &clientAddr, &clientAddrLen, 0);
+            io_uring_sqe *sqe = getSqe(ring);
+            if (useDirectDescriptors) {
+                io_uring_prep_multishot_accept_direct(sqe, fd, nullptr, nullptr, 0);
+            } else {
+                io_uring_prep_multishot_accept(sqe, fd, nullptr, nullptr, 0);
+            }
             io_uring_sqe_set_data(sqe, this);
 
+            isAcceptArmed = true;
             event = Enums::Event::Event_AcceptPublisherConnection;
-            io_uring_submit(ring);
         }
 
         /**
@@ -166,36 +176,150 @@ namespace gazellemq::server {
         void onAcceptConnectionComplete(struct io_uring *ring, int res) {
             if (res < 0) {
                 printError(__PRETTY_FUNCTION__, res);
+                if (!isAcceptArmed) {
+                    // errors such as -ENFILE, a full file table, would fail again right away
+                    acceptRetryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds{ACCEPT_RETRY_MS};
+                }
             } else {
-                // listen for more connections
-                beginAcceptConnection(ring);
+                if (!isAcceptArmed) {
+                    // listen for more connections
+                    beginAcceptConnection(ring);
+                }
 
                 // A client has connected
                 auto client = createHandlerFn(res, serverContext);
-                clients.emplace_back(client);
+                client->setIsDirectDescriptor(useDirectDescriptors);
+                {
+                    std::lock_guard lock{mClients};
+                    clients.emplace_back(client);
+                }
                 afterConnectionAccepted(ring, client);
             }
         }
 
+        /**
+         * Submits the accept again once it has waited long enough after failing. Called on every loop iteration, the
+         * loop's timeout bounds how late it is.
+         * @param ring
+         */
+        void retryAccept(struct io_uring *ring) {
+            if (acceptRetryAt != std::chrono::steady_clock::time_point::max() && acceptRetryAt <= std::chrono::steady_clock::now()) {
+                acceptRetryAt = std::chrono::steady_clock::time_point::max();
+                beginAcceptConnection(ring);
+            }
+        }
+
+        /**
+         * Creates the ring from [ringOptions]. When the kernel rejects a flag, the ring is created again without it.
+         * @param ring
+         */
+        void initRing(io_uring* ring) const {
+            unsigned int flags{IORING_SETUP_CQSIZE};
+            if (ringOptions.sqPoll) {
+                flags |= IORING_SETUP_SQPOLL;
+                if (ringOptions.sqThreadCpu >= 0) {
+                    flags |= IORING_SETUP_SQ_AFF;
+                }
+            } else if (ringOptions.deferTaskrun) {
+                flags |= IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+            } else {
+                flags |= IORING_SETUP_COOP_TASKRUN;
+            }
+
+            if (ringOptions.singleIssuer || (flags & IORING_SETUP_DEFER_TASKRUN)) {
+                flags |= IORING_SETUP_SINGLE_ISSUER;
+            }
+
+            // newest features are given up first
+            std::vector<unsigned int> candidates{flags};
+            auto const fallBack{[&](unsigned int const remove, unsigned int const add) {
+                unsigned int const candidate{(candidates.back() & ~remove) | add};
+                if (candidate != candidates.back()) {
+                    candidates.push_back(candidate);
+                }
+            }};
+            if (flags & IORING_SETUP_DEFER_TASKRUN) {
+                fallBack(IORING_SETUP_DEFER_TASKRUN, IORING_SETUP_COOP_TASKRUN);
+            }
+            fallBack(IORING_SETUP_SINGLE_ISSUER, 0);
+            fallBack(IORING_SETUP_COOP_TASKRUN, 0);
+            fallBack(IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF, 0);
+            fallBack(IORING_SETUP_CQSIZE, 0);
+
+            int ret{};
+            for (unsigned int const candidate : candidates) {
+                io_uring_params params{};
+                params.flags = candidate;
+                params.cq_entries = ringOptions.queueDepth * CQ_ENTRIES_PER_SQE;
+                params.sq_thread_cpu = ringOptions.sqThreadCpu >= 0 ? ringOptions.sqThreadCpu : 0;
+                params.sq_thread_idle = ringOptions.sqThreadIdleMs;
+
+                ret = io_uring_queue_init_params(ringOptions.queueDepth, ring, &params);
+                if (ret == 0) {
+                    if (candidate != flags) {
+                        printf("io_uring set up with flags 0x%x instead of 0x%x\n", candidate, flags);
+                    }
+                    return;
+                }
+
+                if (ret != -EINVAL && ret != -EPERM) {
+                    break;
+                }
+            }
+
+            printError("io_uring_queue_init_params(...)", ret);
+            exit(1);
+        }
+
         virtual void printHello() = 0;
 
         virtual void afterConnectionAccepted(struct io_uring *ring, PubSubHandler* connection) = 0;
 
         virtual void doEventLoop(io_uring* ring) = 0;
     public:
+        void handleCompletion(io_uring* ring, io_uring_cqe const* cqe) override {
+            if (event == Enums::Event::Event_AcceptPublisherConnection) {
+                // the multishot accept stays armed as long as the kernel says there is more
+                isAcceptArmed = (cqe->flags & IORING_CQE_F_MORE) != 0;
+            }
+
+            handleEvent(ring, cqe->res);
+        }
+
         void start() {
             bgThread = std::jthread{[this]() {
                 struct io_uring ring{};
-                io_uring_queue_init(8, &ring, 0);
+                initRing(&ring);
                 handleEvent(&ring, 0);
 
                 doEventLoop(&ring);
             }};
         }
 
+        /**
+         * Returns a copy of the clients. Safe to call from any thread.
+         * @return
+         */
         std::vector<PubSubHandler*> getClients() {
+            std::lock_guard lock{mClients};
             return clients;
         }
+
+        /**
+         * Must be set before start() on every server that shares the port
+         * @param b
+         */
+        void setReusePort(bool b) {
+            reusePort = b;
+        }
+
+        /**
+         * Must be set before start()
+         * @param options
+         */
+        void setRingOptions(RingOptions const& options) {
+            ringOptions = options;
+        }
     };
 }
 
@@ -0,0 +1,30 @@
+#ifndef GAZELLEMQ_SERVER_BATCHPOLICY_HPP
+#define GAZELLEMQ_SERVER_BATCHPOLICY_HPP
+
+#include <limits>
+
+#include "Consts.hpp"
+
+namespace gazellemq::server {
+    /**
+     * When a publisher's batch is sent to the subscribers. A batch is sent as soon as it reaches either size, and
+     * otherwise once it has waited for the linger time. Each message type has its own batch, and a publisher keeps a
+     * few of them open at once.
+     */
+    struct BatchPolicy {
+        size_t maxBytes{DEFAULT_BATCH_MAX_BYTES};
+        unsigned int maxMessages{DEFAULT_BATCH_MAX_MESSAGES};
+
+        // how long complete messages can wait for more, 0 sends them at the end of every receive
+        unsigned long lingerUs{DEFAULT_BATCH_LINGER_US};
+
+        // how many message types can have an open batch, the least recently used one is sent to make room
+        size_t maxOpenBatches{DEFAULT_BATCH_MAX_OPEN};
+
+        // a publisher that sends a bigger message, framing included, is disconnected. Set when the message log needs
+        // every batch to fit in one of its segments.
+        size_t maxMessageBytes{std::numeric_limits<size_t>::max()};
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_BATCHPOLICY_HPP
@@ -0,0 +1,84 @@
+#ifndef GAZELLEMQ_SERVER_BOUNDEDQUEUE_HPP
+#define GAZELLEMQ_SERVER_BOUNDEDQUEUE_HPP
+
+#include <algorithm>
+#include <bit>
+#include <vector>
+
+namespace gazellemq::server {
+    /**
+     * A fixed size FIFO stored in one contiguous allocation. Only used by the thread that owns it.
+     */
+    template<typename T>
+    class BoundedQueue {
+    private:
+        std::vector<T> items;
+        size_t mask{};
+        size_t head{};
+        size_t tail{};
+    public:
+        /**
+         * @param capacity Rounded up to a power of 2
+         */
+        explicit BoundedQueue(size_t capacity)
+            : items(std::bit_ceil(std::max<size_t>(capacity, 1))),
+              mask(items.size() - 1)
+        {}
+    public:
+        [[nodiscard]] size_t size() const {
+            return tail - head;
+        }
+
+        [[nodiscard]] size_t capacity() const {
+            return items.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return head == tail;
+        }
+
+        [[nodiscard]] bool full() const {
+            return size() == items.size();
+        }
+
+        /**
+         * Adds an item at the back. The queue must not be full.
+         * @param item
+         */
+        void push_back(T item) {
+            items[tail++ & mask] = std::move(item);
+        }
+
+        [[nodiscard]] T& front() {
+            return items[head & mask];
+        }
+
+        /**
+         * Returns the item i places from the front
+         * @param i
+         * @return
+         */
+        [[nodiscard]] T& operator[](size_t i) {
+            return items[(head + i) & mask];
+        }
+
+        [[nodiscard]] T const& operator[](size_t i) const {
+            return items[(head + i) & mask];
+        }
+
+        /**
+         * Removes the item at the front, releasing whatever it holds
+         */
+        void pop_front() {
+            items[head++ & mask] = T{};
+        }
+
+        void clear() {
+            while (!empty()) {
+                pop_front();
+            }
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_BOUNDEDQUEUE_HPP
@@ -0,0 +1,160 @@
+#ifndef GAZELLEMQ_SERVER_BUFFERPOOL_HPP
+#define GAZELLEMQ_SERVER_BUFFERPOOL_HPP
+
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include "Consts.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Recycles message batch buffers. Sizes are rounded up to a power of two, and the classes from
+     * DEFAULT_BUF_LENGTH to MAX_POOLED_BUF_LENGTH are kept for reuse instead of being freed. Publishers open batches
+     * with room for the batch size limit plus one message of up to that size, so with the default limit every batch
+     * buffer is pooled.
+     *
+     * Each thread keeps its own cache of every class. Publisher threads allocate the buffers and subscriber threads
+     * usually release them, so caches that grow too big hand a group of buffers to a shared depot, and caches that run
+     * out take a group back. The depot is only locked once per group.
+     */
+    class BufferPool {
+    private:
+        static constexpr size_t MAX_POOLED_BUF_LENGTH = 2 * DEFAULT_BATCH_MAX_BYTES;
+        static constexpr size_t NB_CLASSES = std::countr_zero(MAX_POOLED_BUF_LENGTH) - std::countr_zero(static_cast<size_t>(DEFAULT_BUF_LENGTH)) + 1;
+
+        // how many buffers move between a thread's cache and the depot at once
+        static constexpr size_t GROUP_SIZE = 32;
+
+        // how many bytes of each class the depot keeps, the rest is freed
+        static constexpr size_t MAX_DEPOT_BYTES = 16 * 1048576;
+
+        using Group = std::vector<char*>;
+
+        struct Depot {
+            std::mutex mGroups;
+            std::array<std::vector<Group>, NB_CLASSES> groups;
+
+            ~Depot() {
+                for (std::vector<Group> const& classGroups : groups) {
+                    for (Group const& group : classGroups) {
+                        for (char* buffer : group) {
+                            free(buffer);
+                        }
+                    }
+                }
+            }
+        };
+
+        struct ThreadCache {
+            std::array<Group, NB_CLASSES> buffers;
+
+            ~ThreadCache() {
+                // the buffers outlive the thread, other threads can use them
+                for (size_t i{}; i < NB_CLASSES; ++i) {
+                    if (!buffers[i].empty()) {
+                        giveGroup(i, std::move(buffers[i]));
+                    }
+                }
+            }
+        };
+    public:
+        /**
+         * Returns a buffer of at least [length] chars. [length] is set to the size of the buffer.
+         * @param length
+         * @return
+         */
+        static char* allocate(size_t& length) {
+            length = std::bit_ceil(std::max(length, static_cast<size_t>(DEFAULT_BUF_LENGTH)));
+            if (length > MAX_POOLED_BUF_LENGTH) {
+                return static_cast<char*>(malloc(length));
+            }
+
+            Group& cache{getThreadCache().buffers[getClass(length)]};
+            if (cache.empty() && !takeGroup(getClass(length), cache)) {
+                return static_cast<char*>(malloc(length));
+            }
+
+            char* buffer{cache.back()};
+            cache.pop_back();
+            return buffer;
+        }
+
+        /**
+         * Gives back a buffer returned by allocate()
+         * @param buffer
+         * @param length The size allocate() set
+         */
+        static void deallocate(char* buffer, size_t length) {
+            if (length > MAX_POOLED_BUF_LENGTH) {
+                free(buffer);
+                return;
+            }
+
+            Group& cache{getThreadCache().buffers[getClass(length)]};
+            cache.push_back(buffer);
+            if (cache.size() >= GROUP_SIZE * 2) {
+                Group group{cache.end() - GROUP_SIZE, cache.end()};
+                cache.resize(cache.size() - GROUP_SIZE);
+                giveGroup(getClass(length), std::move(group));
+            }
+        }
+    private:
+        static size_t getClass(size_t length) {
+            return std::countr_zero(length) - std::countr_zero(static_cast<size_t>(DEFAULT_BUF_LENGTH));
+        }
+
+        static Depot& getDepot() {
+            static Depot depot;
+            return depot;
+        }
+
+        static ThreadCache& getThreadCache() {
+            thread_local ThreadCache threadCache;
+            return threadCache;
+        }
+
+        /**
+         * Moves a group of buffers from the depot to the cache
+         * @param bufClass
+         * @param cache
+         * @return false if the depot has none
+         */
+        static bool takeGroup(size_t bufClass, Group& cache) {
+            Depot& depot{getDepot()};
+            std::lock_guard lock{depot.mGroups};
+            if (depot.groups[bufClass].empty()) {
+                return false;
+            }
+
+            cache.swap(depot.groups[bufClass].back());
+            depot.groups[bufClass].pop_back();
+            return true;
+        }
+
+        /**
+         * Moves a group of buffers to the depot, or frees them if the depot already holds enough of their class
+         * @param bufClass
+         * @param group
+         */
+        static void giveGroup(size_t bufClass, Group&& group) {
+            size_t const maxGroups{MAX_DEPOT_BYTES / ((static_cast<size_t>(DEFAULT_BUF_LENGTH) << bufClass) * GROUP_SIZE)};
+            {
+                Depot& depot{getDepot()};
+                std::lock_guard lock{depot.mGroups};
+                if (depot.groups[bufClass].size() < maxGroups) {
+                    depot.groups[bufClass].push_back(std::move(group));
+                    return;
+                }
+            }
+
+            for (char* buffer : group) {
+                free(buffer);
+            }
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_BUFFERPOOL_HPP
@@ -0,0 +1,83 @@
+#ifndef GAZELLEMQ_SERVER_BUFFERRING_HPP
+#define GAZELLEMQ_SERVER_BUFFERRING_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <liburing.h>
+
+namespace gazellemq::server {
+    /**
+     * A group of receive buffers registered with a ring. The kernel picks a free buffer when data arrives, so
+     * connections only hold a buffer while their data is being parsed.
+     */
+    class BufferRing {
+    private:
+        io_uring_buf_ring* bufRing{nullptr};
+        std::unique_ptr<char[]> buffers{};
+        unsigned int const nbBuffers;
+        unsigned int const bufferSize;
+        int const groupId;
+    public:
+        BufferRing(unsigned int const nbBuffers, unsigned int const bufferSize, int const groupId)
+            : nbBuffers(nbBuffers), bufferSize(bufferSize), groupId(groupId)
+        {}
+
+        BufferRing(BufferRing const&) = delete;
+        BufferRing& operator=(BufferRing const&) = delete;
+    public:
+        /**
+         * Registers the buffers with the ring
+         * @param ring
+         */
+        void setup(io_uring* ring) {
+            int ret{};
+            bufRing = io_uring_setup_buf_ring(ring, nbBuffers, groupId, 0, &ret);
+            if (bufRing == nullptr) {
+                printf("%s\n%s\n", "io_uring_setup_buf_ring(...)", strerror(-ret));
+                exit(1);
+            }
+
+            buffers.reset(new char[static_cast<size_t>(nbBuffers) * bufferSize]);
+            for (unsigned int i{}; i < nbBuffers; ++i) {
+                io_uring_buf_ring_add(bufRing, getBufferById(static_cast<unsigned short>(i)), bufferSize, static_cast<unsigned short>(i), io_uring_buf_ring_mask(nbBuffers), static_cast<int>(i));
+            }
+            io_uring_buf_ring_advance(bufRing, static_cast<int>(nbBuffers));
+        }
+
+        /**
+         * Prepares a receive that lets the kernel pick one of these buffers
+         * @param sqe
+         */
+        void selectBuffer(io_uring_sqe* sqe) const {
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = groupId;
+        }
+
+        /**
+         * Returns the buffer the kernel picked for a completion
+         * @param cqeFlags
+         * @return
+         */
+        [[nodiscard]] char* getBuffer(unsigned int const cqeFlags) const {
+            return getBufferById(static_cast<unsigned short>(cqeFlags >> IORING_CQE_BUFFER_SHIFT));
+        }
+
+        /**
+         * Hands the buffer of a completion back to the kernel
+         * @param cqeFlags
+         */
+        void recycle(unsigned int const cqeFlags) {
+            auto const bufferId{static_cast<unsigned short>(cqeFlags >> IORING_CQE_BUFFER_SHIFT)};
+            io_uring_buf_ring_add(bufRing, getBufferById(bufferId), bufferSize, bufferId, io_uring_buf_ring_mask(nbBuffers), 0);
+            io_uring_buf_ring_advance(bufRing, 1);
+        }
+    private:
+        [[nodiscard]] char* getBufferById(unsigned short const bufferId) const {
+            return &buffers[static_cast<size_t>(bufferId) * bufferSize];
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_BUFFERRING_HPP
@@ -12,9 +12,27 @@ namespace gazellemq::server {
     static constexpr auto DEFAULT_BUF_LENGTH = 256;
     static constexpr auto MAX_OUT_BUF = 8192;
     static constexpr auto BIG_READ_BUF = 8192;
+    static constexpr auto NB_PUBLISHER_READ_BUFS = 256;
     static constexpr auto LAST_MSG_BUF_SIZE = 4096;
     static constexpr auto DEFAULT_OUT_QUEUE_DEPTH = 64;
     static constexpr auto DEFAULT_IN_QUEUE_DEPTH = 8;
+    static constexpr auto DEFAULT_MAX_CONNECTIONS = 16384;
+    static constexpr auto ACCEPT_RETRY_MS = 100;
+    static constexpr auto DEFAULT_MESSAGE_QUEUE_DEPTH = 8192;
+    static constexpr auto DEFAULT_MAX_QUEUED_BYTES = 256 * 1048576;
+    static constexpr auto DEFAULT_RING_DEPTH = 4096;
+    static constexpr auto CQ_ENTRIES_PER_SQE = 4;
+    static constexpr auto DEFAULT_SQ_THREAD_IDLE_MS = 1000;
+    static constexpr auto MAX_GATHER_BYTES = 1048576;
+    static constexpr auto DEFAULT_SUBSCRIBER_QUEUE_DEPTH = 1024;
+    static constexpr auto DEFAULT_BATCH_MAX_BYTES = 32768;
+    static constexpr auto DEFAULT_BATCH_MAX_MESSAGES = 4096;
+    static constexpr auto DEFAULT_BATCH_LINGER_US = 0;
+    static constexpr auto DEFAULT_BATCH_MAX_OPEN = 8;
+    static constexpr auto DEFAULT_LOG_SEGMENT_SIZE = 64 * 1048576;
+    static constexpr auto DEFAULT_LOG_COMMIT_US = 2000;
+    static constexpr auto DEFAULT_LOG_COMMIT_BYTES = 1048576;
+    static constexpr auto LOG_RING_DEPTH = 256;
     static constexpr auto TIMEOUT = -62;
     static inline const auto DEFAULT_NB_THREADS = std::thread::hardware_concurrency();
 }
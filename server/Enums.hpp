@@ -1,6 +1,8 @@
 #ifndef GAZELLEMQ_ENUMS_HPP
 #define GAZELLEMQ_ENUMS_HPP
 
+#include <string_view>
+
 namespace gazellemq::server {
     enum VResult {
         V_SUCCEEDED,
@@ -14,12 +16,11 @@ namespace gazellemq::server {
             Event_NotSet,
             Event_Idle,
             Event_Ready,
-            Event_SetupPublisherListeningSocket,
             Event_AcceptPublisherConnection,
-            Event_SetNonblockingPublisher,
             Event_ReceiveIntent,
             Event_Disconnected,
             Event_ReceivePublisherData,
+            Event_CancelReceive,
             Event_ReceiveTimeout,
             Event_ReceiveSubscriptions,
             Event_ReceiveName,
@@ -29,6 +30,36 @@ namespace gazellemq::server {
             Event_ReceiveHttpUpgrade,
             Event_SendWSHandshake
         };
+
+        // what happens when a subscriber's send queue is full
+        enum SlowConsumerPolicy {
+            // stop fanning out until the subscriber catches up, which pushes back on the publishers
+            SlowConsumer_Block,
+            SlowConsumer_DropOldest,
+            SlowConsumer_DropNewest,
+            SlowConsumer_Disconnect
+        };
+
+        /**
+         * Reads a policy name, one of block, drop-oldest, drop-newest or disconnect
+         * @param value
+         * @param policy
+         * @return false if the name is not known
+         */
+        static bool parseSlowConsumerPolicy(std::string_view value, SlowConsumerPolicy& policy) {
+            if (value == "block") {
+                policy = SlowConsumer_Block;
+            } else if (value == "drop-oldest") {
+                policy = SlowConsumer_DropOldest;
+            } else if (value == "drop-newest") {
+                policy = SlowConsumer_DropNewest;
+            } else if (value == "disconnect") {
+                policy = SlowConsumer_Disconnect;
+            } else {
+                return false;
+            }
+            return true;
+        }
     };
 }
 
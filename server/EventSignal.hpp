@@ -0,0 +1,89 @@
+#ifndef GAZELLEMQ_SERVER_EVENTSIGNAL_HPP
+#define GAZELLEMQ_SERVER_EVENTSIGNAL_HPP
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "BaseObject.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Wakes an event loop from other threads. The loop reads the eventfd with its own ring, so wakeups and I/O
+     * completions are waited on together.
+     */
+    class EventSignal final : public BaseObject {
+    private:
+        int eventFd{-1};
+        uint64_t eventFdValue{};
+
+        // set by the first notify() after the loop last looked, so a burst of notifications costs one write
+        std::atomic_flag isSignalled{false};
+        bool isReady{false};
+    public:
+        EventSignal() {
+            eventFd = eventfd(0, EFD_CLOEXEC);
+            if (eventFd < 0) {
+                printf("%s\n", "eventfd(...)");
+                exit(1);
+            }
+        }
+
+        ~EventSignal() override {
+            close(eventFd);
+        }
+    public:
+        /**
+         * Wakes the loop. Safe to call from any thread.
+         */
+        void notify() {
+            // orders what the caller stored before reading the flag, pairs with the fence in takeIsReady()
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            // checking first keeps the cache line shared while the loop has not looked yet
+            if (!isSignalled.test() && !isSignalled.test_and_set()) {
+                uint64_t const one{1};
+                if (write(eventFd, &one, sizeof(one)) < 0) {
+                    printf("%s\n", "write(eventfd)");
+                }
+            }
+        }
+
+        /**
+         * Waits, on the loop's ring, for the next notify()
+         * @param ring
+         */
+        void beginWait(io_uring* ring) {
+            io_uring_sqe* sqe = getSqe(ring);
+            io_uring_prep_read(sqe, eventFd, &eventFdValue, sizeof(eventFdValue), 0);
+            io_uring_sqe_set_data(sqe, this);
+        }
+
+        void handleEvent(io_uring* ring, int res) override {
+            if (res < 0) {
+                printf("%s\n%s\n", "EventSignal::handleEvent", strerror(-res));
+            }
+            isReady = true;
+        }
+
+        /**
+         * Returns true if notify() was called since the last call. Whatever the notification was about must be
+         * handled afterwards, any notify() from here on wakes the loop again.
+         * @return
+         */
+        bool takeIsReady() {
+            if (!isReady) {
+                return false;
+            }
+
+            isReady = false;
+            isSignalled.clear();
+
+            // pairs with the fence in notify(), either the loop sees what the notifier stored or the notifier sees the
+            // flag clear and writes again
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return true;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_EVENTSIGNAL_HPP
@@ -4,30 +4,55 @@
 #include <cstring>
 #include <cstdlib>
 #include <algorithm>
-#include <cmath>
+#include <charconv>
+#include <memory>
+#include <string_view>
 
+#include "BufferPool.hpp"
 #include "Consts.hpp"
+#include "MessageTypes.hpp"
 
 namespace gazellemq::server {
+    class PublisherAcks;
+
     struct MessageBatch {
     private:
-        static constexpr size_t SIZEOF_CHAR = sizeof(char);
         static constexpr size_t GROW_UNTIL_LENGTH = DEFAULT_BUF_LENGTH * 128;
-        std::string messageType{};
+        MessageTypeId messageType{NO_MESSAGE_TYPE};
         char *buffer{nullptr};
         size_t maxLength{};
         size_t bufferLength{};
-        size_t bufferPosition{};
         unsigned int nbMessages{};
-        bool isBusy{};
+
+        // where the most recently appended message starts
+        size_t lastMessageOffset{};
+
+        // set when the buffer belongs to something else, which is kept alive for as long as the batch
+        std::shared_ptr<void const> owner{};
+
+        // set when the publisher wants to know once the batch is committed to the message log
+        std::shared_ptr<PublisherAcks> acks{};
     public:
         MessageBatch(MessageBatch const &) = delete;
 
         MessageBatch &operator=(MessageBatch const &) = delete;
 
-        MessageBatch(): maxLength(DEFAULT_BUF_LENGTH) {
-            buffer = static_cast<char *>(calloc(maxLength, sizeof(char)));
-        }
+        MessageBatch() = default;
+
+        /**
+         * Makes a read-only batch over bytes owned by something else, so they can be sent without being copied
+         * @param messageType
+         * @param data
+         * @param length
+         * @param owner
+         */
+        MessageBatch(MessageTypeId messageType, char const* data, size_t length, std::shared_ptr<void const> owner)
+            : messageType(messageType),
+              buffer(const_cast<char*>(data)),
+              maxLength(length),
+              bufferLength(length),
+              owner(std::move(owner))
+        {}
 
         MessageBatch(MessageBatch &&other) noexcept {
             this->swap(std::move(other));
@@ -39,8 +64,8 @@ namespace gazellemq::server {
         }
 
         ~MessageBatch() {
-            if (buffer != nullptr) {
-                free(buffer);
+            if (buffer != nullptr && owner == nullptr) {
+                BufferPool::deallocate(buffer, maxLength);
             }
         }
     private:
@@ -48,12 +73,33 @@ namespace gazellemq::server {
             std::swap(this->buffer, other.buffer);
             std::swap(this->maxLength, other.maxLength);
             std::swap(this->bufferLength, other.bufferLength);
-            std::swap(this->bufferPosition, other.bufferPosition);
             std::swap(this->messageType, other.messageType);
             std::swap(this->nbMessages, other.nbMessages);
-            std::swap(this->isBusy, other.isBusy);
+            std::swap(this->lastMessageOffset, other.lastMessageOffset);
+            std::swap(this->owner, other.owner);
+            std::swap(this->acks, other.acks);
         }
     public:
+        /**
+         * Grows the buffer, to the next size of the buffer pool, so that it can hold [extra] more chars. Publishers
+         * reserve what a full batch needs when they open one, so its messages are only copied in once.
+         * @param extra
+         */
+        void reserve(size_t extra) {
+            if (bufferLength + extra <= maxLength && buffer != nullptr) {
+                return;
+            }
+
+            size_t newLength{bufferLength + extra};
+            char* newBuffer{BufferPool::allocate(newLength)};
+            if (buffer != nullptr) {
+                memcpy(newBuffer, buffer, bufferLength);
+                BufferPool::deallocate(buffer, maxLength);
+            }
+            buffer = newBuffer;
+            maxLength = newLength;
+        }
+
         /**
          * Tries to append the passed in chars. Returns false if the chars cannot fit in the remaining buffer space.
          * @param message
@@ -64,42 +110,69 @@ namespace gazellemq::server {
                 return false;
             }
 
-            if (message.size() + bufferLength > maxLength) {
-                size_t byteSize{static_cast<size_t>((std::ceil(static_cast<double>(maxLength + message.size()) / DEFAULT_BUF_LENGTH) * DEFAULT_BUF_LENGTH))};
-                buffer = (buffer == nullptr)
-                    ? static_cast<char *>(calloc(byteSize, SIZEOF_CHAR))
-                    : static_cast<char *>(realloc(buffer, byteSize));
-                maxLength += message.size();
-            }
+            reserve(message.size());
 
-            memmove(&buffer[bufferLength], message.c_str(), SIZEOF_CHAR * message.size());
+            lastMessageOffset = bufferLength;
+            memcpy(&buffer[bufferLength], message.c_str(), message.size());
             bufferLength += message.size();
+            ++nbMessages;
 
             return true;
         }
 
-        void copy(MessageBatch const& other) {
-            if (other.bufferLength + bufferLength > maxLength) {
-                size_t byteSize{static_cast<size_t>((std::ceil(static_cast<double>(maxLength + other.maxLength) / DEFAULT_BUF_LENGTH) * DEFAULT_BUF_LENGTH))};
-                buffer = (buffer == nullptr)
-                         ? (char *) calloc(byteSize, SIZEOF_CHAR)
-                         : (char *) realloc(buffer, byteSize);
-                maxLength += other.bufferLength;
-            }
+        /**
+         * Appends chars without counting a message, for a message that is written as it is parsed. endMessage() is
+         * called once it is complete.
+         * @param data
+         * @param length
+         */
+        void appendRaw(char const* data, size_t length) {
+            reserve(length);
+            memcpy(&buffer[bufferLength], data, length);
+            bufferLength += length;
+        }
 
-            memmove(&buffer[bufferLength], other.buffer, SIZEOF_CHAR * other.bufferLength);
-            bufferLength += other.bufferLength;
+        /**
+         * Counts the message that was written with appendRaw() from [messageOffset]
+         * @param messageOffset
+         */
+        void endMessage(size_t messageOffset) {
+            lastMessageOffset = messageOffset;
+            ++nbMessages;
+        }
 
-            this->messageType = other.messageType;
-            this->nbMessages = other.nbMessages;
-            this->bufferPosition = 0;
-            this->isBusy = false;
+        /**
+         * Drops the chars from [length] onwards
+         * @param length
+         */
+        void truncate(size_t length) {
+            bufferLength = std::min(bufferLength, length);
         }
 
-        [[nodiscard]] MessageBatch copy() const {
-            MessageBatch retVal{};
-            retVal.copy(*this);
-            return std::move(retVal);
+        /**
+         * Appends a message in the text framing, type|length|content, without building it in a string first
+         * @param type
+         * @param content
+         * @param contentLength
+         */
+        void appendMessage(std::string_view type, char const* content, size_t contentLength) {
+            char length[24];
+            size_t const lengthLength{static_cast<size_t>(std::to_chars(length, length + sizeof(length), contentLength).ptr - length)};
+            size_t const messageLength{type.size() + 1 + lengthLength + 1 + contentLength};
+            reserve(messageLength);
+
+            char* out{&buffer[bufferLength]};
+            memcpy(out, type.data(), type.size());
+            out += type.size();
+            *out++ = '|';
+            memcpy(out, length, lengthLength);
+            out += lengthLength;
+            *out++ = '|';
+            memcpy(out, content, contentLength);
+
+            lastMessageOffset = bufferLength;
+            bufferLength += messageLength;
+            ++nbMessages;
         }
 
         /**
@@ -111,65 +184,91 @@ namespace gazellemq::server {
         }
 
         /**
-         * Returns the messageType
+         * Returns the size of the buffer, which is what the batch holds on to
          * @return
          */
-        [[nodiscard]] std::string getMessageType() const {
-            return messageType;
+        [[nodiscard]] size_t getCapacity() const {
+            return maxLength;
         }
 
         /**
-         * Returns the buffer starting from the read position
-         * @return
+         * Moves the chars to a buffer of the smallest pool size that holds them, when they use less than a quarter of
+         * the buffer. Publishers open batches with room for a full one, so the ones sent early are shrunk before they
+         * are queued.
          */
-        [[nodiscard]] char const* getBufferRemaining() const {
-            return &buffer[bufferPosition];
+        void shrinkToFit() {
+            if (buffer == nullptr || owner != nullptr || bufferLength * 4 > maxLength) {
+                return;
+            }
+
+            size_t newLength{bufferLength};
+            char* newBuffer{BufferPool::allocate(newLength)};
+            memcpy(newBuffer, buffer, bufferLength);
+            BufferPool::deallocate(buffer, maxLength);
+            buffer = newBuffer;
+            maxLength = newLength;
         }
 
         /**
-         * Advances the read position
-         * @param amount
+         * Returns the number of messages appended since the batch was last cleared
+         * @return
          */
-        void advance(size_t amount) {
-            bufferPosition = (bufferPosition + amount) <= maxLength ? (bufferPosition + amount) : maxLength;
-            bufferLength = (bufferLength - amount) >= 0 ? (bufferLength - amount) : 0;
+        [[nodiscard]] unsigned int getNbMessages() const {
+            return nbMessages;
         }
 
-        void clearForNextMessage() {
-            if (this->buffer != nullptr) {
-                memset(this->buffer, 0, this->maxLength);
-            }
+        /**
+         * Returns the offset of the most recently appended message
+         * @return
+         */
+        [[nodiscard]] size_t getLastMessageOffset() const {
+            return lastMessageOffset;
+        }
 
-            this->bufferLength = 0;
-            this->bufferPosition = 0;
-            this->nbMessages = 0;
-            this->isBusy = false;
+        void setAcks(std::shared_ptr<PublisherAcks> const& value) {
+            this->acks = value;
         }
 
-        [[nodiscard]] bool getIsBusy() const {
-            return isBusy;
+        [[nodiscard]] std::shared_ptr<PublisherAcks> const& getAcks() const {
+            return acks;
         }
 
-        [[nodiscard]] bool isFull() const {
-            return bufferLength > GROW_UNTIL_LENGTH;
+        /**
+         * Returns the id of the messageType
+         * @return
+         */
+        [[nodiscard]] MessageTypeId getMessageType() const {
+            return messageType;
         }
 
-        void setBusy() {
-            isBusy = true;
+        /**
+         * Returns the start of the buffer
+         * @return
+         */
+        [[nodiscard]] char const* getBuffer() const {
+            return buffer;
         }
 
-        void setMessageType(std::string const& value) {
-            this->messageType = value;
+        void clearForNextMessage() {
+            this->bufferLength = 0;
+            this->nbMessages = 0;
+            this->lastMessageOffset = 0;
+            this->acks.reset();
         }
 
-        [[nodiscard]] bool getIsDone() const {
-            return bufferLength == 0;
+        void setMessageType(MessageTypeId value) {
+            this->messageType = value;
         }
 
         [[nodiscard]] bool hasContent() const {
             return bufferLength > 0;
         }
     };
+
+    /**
+     * A published batch that is shared, read-only, between every subscriber it is fanned out to
+     */
+    using SharedMessageBatch = std::shared_ptr<MessageBatch const>;
 }
 
 #endif //GAZELLEMQ_SERVER_MESSAGEBATCH_HPP
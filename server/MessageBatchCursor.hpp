@@ -0,0 +1,68 @@
+#ifndef GAZELLEMQ_SERVER_MESSAGEBATCHCURSOR_HPP
+#define GAZELLEMQ_SERVER_MESSAGEBATCHCURSOR_HPP
+
+#include "MessageBatch.hpp"
+
+namespace gazellemq::server {
+    /**
+     * A subscriber's send position into a shared batch. The batch itself is never modified, so every subscriber
+     * sends from the same bytes.
+     */
+    struct MessageBatchCursor {
+    private:
+        SharedMessageBatch batch{};
+        size_t position{};
+    public:
+        MessageBatchCursor() = default;
+
+        explicit MessageBatchCursor(SharedMessageBatch batch)
+            : batch(std::move(batch))
+        {}
+    public:
+        [[nodiscard]] SharedMessageBatch const& getBatch() const {
+            return batch;
+        }
+
+        /**
+         * Returns the batch starting from the send position
+         * @return
+         */
+        [[nodiscard]] char const* getBufferRemaining() const {
+            return &batch->getBuffer()[position];
+        }
+
+        /**
+         * Returns the number of characters that are left to send
+         * @return
+         */
+        [[nodiscard]] size_t getBufferLength() const {
+            return batch->getBufferLength() - position;
+        }
+
+        /**
+         * Advances the send position
+         * @param amount
+         */
+        void advance(size_t amount) {
+            position = std::min(position + amount, batch->getBufferLength());
+        }
+
+        [[nodiscard]] bool hasContent() const {
+            return batch != nullptr && position < batch->getBufferLength();
+        }
+
+        [[nodiscard]] bool getIsDone() const {
+            return !hasContent();
+        }
+
+        /**
+         * Releases this subscriber's reference to the batch
+         */
+        void reset() {
+            batch.reset();
+            position = 0;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_MESSAGEBATCHCURSOR_HPP
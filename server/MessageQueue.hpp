@@ -1,48 +1,325 @@
 #ifndef GAZELLEMQ_SERVER_MESSAGEQUEUE_HPP
 #define GAZELLEMQ_SERVER_MESSAGEQUEUE_HPP
 
-#include <condition_variable>
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
 
+#include "EventSignal.hpp"
 #include "MessageBatch.hpp"
-#include "../lib/MPMCQueue/MPMCQueue.hpp"
+#include "MessageQueueOptions.hpp"
+#include "SPSCQueue.hpp"
 
 namespace gazellemq::server {
+    /**
+     * Identifies a thread that publishes to the message bus, each one has its own queue to every consumer
+     */
+    using ProducerId = size_t;
+
+    /**
+     * The published batches waiting to be handled by one consumer, such as a subscriber loop. Every producer has its
+     * own single producer queue, polled round-robin by the consumer, so producers never contend with each other and
+     * the batches of one producer stay in order. Producers wake the consumer through an EventSignal that it waits on
+     * with its own ring, so new messages and I/O completions are waited on together.
+     *
+     * Each producer's queue is bounded by slots, and the consumer has one byte budget shared by all of them, so the
+     * bytes queued for a consumer do not grow with the number of producers. Batches are charged the size of their
+     * buffers, not of their content, so the budget bounds the memory they hold. A producer that has no room is told so
+     * instead of waiting, and its room signal is notified once the consumer has taken a batch.
+     */
     class MessageQueue {
     private:
-        rigtorp::MPMCQueue<MessageBatch> messageQueue;
-    public:
-        std::atomic_flag afQueue{false};
+        static constexpr size_t MAX_PRODUCERS = 256;
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+
+        struct ProducerQueue {
+            SPSCQueue<SharedMessageBatch> batches;
+
+            // wakes the producer's loop when it has been told there is no room and the consumer takes a batch
+            EventSignal* roomSignal;
+            alignas(CACHE_LINE_SIZE) std::atomic<bool> isProducerWaiting{false};
+
+            ProducerQueue(size_t depth, EventSignal* roomSignal)
+                : batches(depth),
+                  roomSignal(roomSignal)
+            {}
+        };
 
-        std::mutex mQueue;
-        std::condition_variable cvQueue{};
-        std::atomic_flag hasPendingData{false};
+        MessageQueueOptions options;
+        EventSignal signal{};
+        std::array<std::unique_ptr<ProducerQueue>, MAX_PRODUCERS> producerQueues{};
+        std::atomic<size_t> nbProducers{0};
+
+        // bytes pushed by every producer and not taken yet, and how many producers were refused and wait for room
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> nbQueuedBytes{};
+        std::atomic<size_t> nbWaitingProducers{};
+
+        // only used by the consumer, the producer to poll first
+        size_t nextProducer{};
     public:
-        explicit MessageQueue(const size_t messageQueueDepth)
-            :messageQueue(messageQueueDepth)
+        explicit MessageQueue(MessageQueueOptions const& options)
+            : options(options)
         {}
     public:
-        void push_back(MessageBatch &&chunk) {
-            messageQueue.push(std::move(chunk));
-            afQueue.test_and_set();
-            afQueue.notify_one();
-
-            {
-                std::lock_guard lock{mQueue};
-                if (!hasPendingData.test()) {
-                    hasPendingData.test_and_set();
-                    cvQueue.notify_all();
+        /**
+         * Adds the queue of the next producer. Producers can be added while the consumer is running, but never
+         * concurrently with each other.
+         * @param roomSignal Notified when the producer was refused a batch and the consumer has taken one since
+         */
+        void addProducer(EventSignal* roomSignal) {
+            size_t const i{nbProducers.load(std::memory_order_relaxed)};
+            if (i == MAX_PRODUCERS) {
+                printf("%s\n", "Too many message producers");
+                exit(1);
+            }
+
+            producerQueues[i] = std::make_unique<ProducerQueue>(options.depth, roomSignal);
+            nbProducers.store(i + 1, std::memory_order_release);
+        }
+
+        /**
+         * Queues the producer's batch, unless the producer's queue is full or the consumer already has too many bytes
+         * to take. A consumer with nothing queued takes any batch, so one bigger than the limit still goes through.
+         * @param producer
+         * @param chunk Left as is when there is no room
+         * @return false if there is no room, the producer's room signal is notified once there may be
+         */
+        bool try_push_back(ProducerId producer, SharedMessageBatch& chunk) {
+            ProducerQueue& queue{*producerQueues[producer]};
+            size_t const length{chunk->getCapacity()};
+            if (!tryReserve(queue, length)) {
+                if (!queue.isProducerWaiting.exchange(true)) {
+                    nbWaitingProducers.fetch_add(1);
+                }
+
+                // the consumer may have taken a batch before it could see the flag
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!tryReserve(queue, length)) {
+                    return false;
+                }
+
+                if (queue.isProducerWaiting.exchange(false)) {
+                    nbWaitingProducers.fetch_sub(1);
                 }
             }
+
+            queue.batches.try_push(std::move(chunk));
+            signal.notify();
+            return true;
         }
 
-        bool try_pop(MessageBatch& chunk) {
-            return messageQueue.try_pop(chunk);
+        /**
+         * Takes the next batch, from the producers in turn
+         * @param chunk
+         * @return false if no producer has a batch
+         */
+        bool try_pop(SharedMessageBatch& chunk) {
+            size_t const n{nbProducers.load(std::memory_order_acquire)};
+            for (size_t i{}; i < n; ++i) {
+                ProducerQueue& queue{*producerQueues[nextProducer]};
+                nextProducer = (nextProducer + 1 < n) ? nextProducer + 1 : 0;
+
+                if (queue.batches.try_pop(chunk)) {
+                    nbQueuedBytes.fetch_sub(chunk->getCapacity());
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (nbWaitingProducers.load() > 0) {
+                        wakeWaitingProducers(n);
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Waits, on the consumer's ring, for publishers to signal that there are batches
+         * @param ring
+         */
+        void beginWait(io_uring* ring) {
+            signal.beginWait(ring);
+        }
+
+        /**
+         * Returns true if publishers have signalled since the last call. The queue must be drained afterwards, any
+         * batch pushed from here on signals again.
+         * @return
+         */
+        bool takeIsReady() {
+            return signal.takeIsReady();
+        }
+    private:
+        /**
+         * Takes a slot's worth of room in the producer's queue and the bytes from the shared budget. Only called by the
+         * producer.
+         * @param queue
+         * @param length
+         * @return false if there is no room
+         */
+        bool tryReserve(ProducerQueue& queue, size_t length) {
+            if (queue.batches.full()) {
+                return false;
+            }
+
+            size_t nbBytes{nbQueuedBytes.load()};
+            do {
+                if (nbBytes != 0 && nbBytes + length > options.maxQueuedBytes) {
+                    return false;
+                }
+            } while (!nbQueuedBytes.compare_exchange_weak(nbBytes, nbBytes + length));
+            return true;
+        }
+
+        /**
+         * Notifies the producers that were refused, any of them may fit now. Only called by the consumer.
+         * @param n The number of producers
+         */
+        void wakeWaitingProducers(size_t n) {
+            for (size_t i{}; i < n; ++i) {
+                ProducerQueue& queue{*producerQueues[i]};
+                if (queue.isProducerWaiting.load() && queue.isProducerWaiting.exchange(false)) {
+                    nbWaitingProducers.fetch_sub(1);
+                    queue.roomSignal->notify();
+                }
+            }
+        }
+    };
+
+    /**
+     * Hands every published batch to the queue of each consumer, such as the subscriber loops. The batch is shared,
+     * not copied.
+     *
+     * Producers never wait for consumers. A batch that a consumer has no room for is kept, with the batches published
+     * after it, until the producer retries once its room signal is notified. Meanwhile the producer is expected to
+     * stop taking in more, see ReceiveThrottle.
+     */
+    class MessageBus {
+    private:
+        static constexpr size_t MAX_QUEUES = 1024;
+        static constexpr size_t MAX_PRODUCERS = 256;
+
+        /**
+         * A batch that some of the queues, from nextQueue on, have not taken yet
+         */
+        struct PendingBatch {
+            SharedMessageBatch batch;
+            size_t nextQueue;
+        };
+
+        struct Producer {
+            EventSignal* roomSignal;
+
+            // only used by the producer's thread
+            std::deque<PendingBatch> pendingBatches{};
+        };
+
+        std::array<MessageQueue*, MAX_QUEUES> queues{};
+        std::atomic<size_t> nbQueues{0};
+        std::array<std::unique_ptr<Producer>, MAX_PRODUCERS> producers{};
+
+        // queues and producers are added while the servers are created
+        std::mutex mSetup;
+        size_t nbProducers{};
+    public:
+        /**
+         * Adds a queue that receives every published batch. Queues are added while the servers are created, before
+         * any publisher can connect.
+         * @param queue
+         */
+        void addQueue(MessageQueue* queue) {
+            std::lock_guard lock{mSetup};
+            size_t const i{nbQueues.load(std::memory_order_relaxed)};
+            if (i == MAX_QUEUES) {
+                printf("%s\n", "Too many message queues");
+                exit(1);
+            }
+
+            for (size_t producer{}; producer < nbProducers; ++producer) {
+                queue->addProducer(producers[producer]->roomSignal);
+            }
+
+            queues[i] = queue;
+            nbQueues.store(i + 1, std::memory_order_release);
+        }
+
+        /**
+         * Adds a producer, a thread that publishes batches, and returns its id
+         * @param roomSignal Notified when a queue that had no room for the producer's batches has taken one
+         * @return
+         */
+        ProducerId addProducer(EventSignal* roomSignal) {
+            std::lock_guard lock{mSetup};
+            if (nbProducers == MAX_PRODUCERS) {
+                printf("%s\n", "Too many message producers");
+                exit(1);
+            }
+
+            size_t const n{nbQueues.load(std::memory_order_relaxed)};
+            for (size_t i{}; i < n; ++i) {
+                queues[i]->addProducer(roomSignal);
+            }
+
+            producers[nbProducers] = std::make_unique<Producer>(Producer{roomSignal});
+            return nbProducers++;
+        }
+
+        /**
+         * Publishes the batch, or keeps it for later if a queue has no room or older batches are still kept
+         * @param producer
+         * @param batch
+         */
+        void push_back(ProducerId producer, MessageBatch &&batch) {
+            PendingBatch pending{std::make_shared<MessageBatch>(std::move(batch)), 0};
+
+            std::deque<PendingBatch>& pendingBatches{producers[producer]->pendingBatches};
+            if (!pendingBatches.empty() || !tryPush(producer, pending)) {
+                pendingBatches.push_back(std::move(pending));
+            }
+        }
+
+        /**
+         * Publishes the batches that were kept, in order, as long as the queues have room
+         * @param producer
+         * @return true if every kept batch was published
+         */
+        bool retry(ProducerId producer) {
+            std::deque<PendingBatch>& pendingBatches{producers[producer]->pendingBatches};
+            while (!pendingBatches.empty() && tryPush(producer, pendingBatches.front())) {
+                pendingBatches.pop_front();
+            }
+            return pendingBatches.empty();
+        }
+
+        /**
+         * Returns true if the producer has batches that some queue has not taken yet
+         * @param producer
+         * @return
+         */
+        [[nodiscard]] bool hasPending(ProducerId producer) const {
+            return !producers[producer]->pendingBatches.empty();
+        }
+    private:
+        /**
+         * Hands the batch to the queues that have not taken it yet
+         * @param producer
+         * @param pending
+         * @return false if a queue had no room, pending.nextQueue is then that queue
+         */
+        bool tryPush(ProducerId producer, PendingBatch& pending) {
+            size_t const n{nbQueues.load(std::memory_order_acquire)};
+            for (; pending.nextQueue < n; ++pending.nextQueue) {
+                SharedMessageBatch batch{pending.batch};
+                if (!queues[pending.nextQueue]->try_push_back(producer, batch)) {
+                    return false;
+                }
+            }
+            return true;
         }
     };
 
-    static inline MessageQueue _mcq{1000000};
+    static inline MessageBus _mcq{};
 
-    static MessageQueue& getMessageQueue() {
+    static MessageBus& getMessageBus() {
         return gazellemq::server::_mcq;
     }
 }
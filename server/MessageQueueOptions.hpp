@@ -0,0 +1,30 @@
+#ifndef GAZELLEMQ_SERVER_MESSAGEQUEUEOPTIONS_HPP
+#define GAZELLEMQ_SERVER_MESSAGEQUEUEOPTIONS_HPP
+
+#include "Consts.hpp"
+
+namespace gazellemq::server {
+    /**
+     * How big the queues of published batches are. Every consumer has one queue per producer, and one byte budget
+     * shared by all of them.
+     */
+    struct MessageQueueOptions {
+        // number of slots of each producer's queue, each one holds a pointer to a shared batch
+        size_t depth{DEFAULT_MESSAGE_QUEUE_DEPTH};
+
+        // producers stop taking in more when a consumer has this many bytes of batches it has not taken yet
+        size_t maxQueuedBytes{DEFAULT_MAX_QUEUED_BYTES};
+    };
+
+    static inline MessageQueueOptions _messageQueueOptions{};
+
+    /**
+     * Returns the options the message queues are created with. They must be set before any queue is created.
+     * @return
+     */
+    static MessageQueueOptions& getMessageQueueOptions() {
+        return gazellemq::server::_messageQueueOptions;
+    }
+}
+
+#endif //GAZELLEMQ_SERVER_MESSAGEQUEUEOPTIONS_HPP
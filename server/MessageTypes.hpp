@@ -0,0 +1,102 @@
+#ifndef GAZELLEMQ_SERVER_MESSAGETYPES_HPP
+#define GAZELLEMQ_SERVER_MESSAGETYPES_HPP
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace gazellemq::server {
+    /**
+     * Compact id of an interned message type
+     */
+    using MessageTypeId = uint32_t;
+
+    static constexpr MessageTypeId NO_MESSAGE_TYPE = std::numeric_limits<MessageTypeId>::max();
+
+    /**
+     * Hashes message types, so maps keyed by std::string can be searched with a std::string_view
+     */
+    struct MessageTypeHash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view value) const {
+            return std::hash<std::string_view>{}(value);
+        }
+    };
+
+    /**
+     * Message types and their ids
+     */
+    using MessageTypeIds = std::unordered_map<std::string, MessageTypeId, MessageTypeHash, std::equal_to<>>;
+
+    /**
+     * Interns message types so the rest of the pipeline can carry and compare a 32-bit id instead of a string.
+     * Ids are dense, so they can be used to index arrays.
+     */
+    class MessageTypeRegistry {
+    private:
+        mutable std::mutex mRegistry;
+        MessageTypeIds ids;
+        std::deque<std::string> names;
+    public:
+        /**
+         * Returns the id of the passed in message type, registering it if it is new
+         * @param messageType
+         * @return
+         */
+        MessageTypeId intern(std::string_view messageType) {
+            std::lock_guard lock{mRegistry};
+            auto it{ids.find(messageType)};
+            if (it != ids.end()) {
+                return it->second;
+            }
+
+            auto const id{static_cast<MessageTypeId>(names.size())};
+            names.emplace_back(messageType);
+            ids.emplace(names.back(), id);
+            return id;
+        }
+
+        /**
+         * Returns the id of the passed in message type without registering it
+         * @param messageType
+         * @return NO_MESSAGE_TYPE if it was never interned
+         */
+        [[nodiscard]] MessageTypeId find(std::string_view messageType) const {
+            std::lock_guard lock{mRegistry};
+            auto it{ids.find(messageType)};
+            return it != ids.end() ? it->second : NO_MESSAGE_TYPE;
+        }
+
+        /**
+         * Returns the message type of the passed in id
+         * @param id
+         * @return
+         */
+        [[nodiscard]] std::string const& getName(MessageTypeId id) const {
+            std::lock_guard lock{mRegistry};
+            return names.at(id);
+        }
+
+        /**
+         * Returns the number of interned message types
+         * @return
+         */
+        [[nodiscard]] size_t size() const {
+            std::lock_guard lock{mRegistry};
+            return names.size();
+        }
+    };
+
+    static inline MessageTypeRegistry _messageTypes{};
+
+    static MessageTypeRegistry& getMessageTypes() {
+        return gazellemq::server::_messageTypes;
+    }
+}
+
+#endif //GAZELLEMQ_SERVER_MESSAGETYPES_HPP
@@ -3,7 +3,6 @@
 
 #include <cstring>
 #include <iostream>
-#include <sys/epoll.h>
 
 #include "Enums.hpp"
 #include "BaseObject.hpp"
@@ -17,12 +16,13 @@ namespace gazellemq::server {
         static constexpr auto NB_INTENT_CHARS = 2;
 
         int fd;
-        char readBuffer[8192]{};
+        char readBuffer[MAX_HANDSHAKE_BUF]{};
         std::string intent{};
         Enums::Event event{Enums::Event::Event_NotSet};
         std::string clientName{};
         ServerContext* serverContext{nullptr};
         bool isDisconnected{false};
+        bool isDirectDescriptor{false};
     public:
         explicit PubSubHandler(int res, ServerContext* serverContext)
                 :fd(res), serverContext(serverContext)
@@ -49,6 +49,7 @@ namespace gazellemq::server {
             std::swap(this->event, other.event);
             std::swap(this->clientName, other.clientName);
             std::swap(this->isDisconnected, other.isDisconnected);
+            std::swap(this->isDirectDescriptor, other.isDirectDescriptor);
         }
     public:
         [[nodiscard]] std::string getClientName() const {
@@ -63,6 +64,14 @@ namespace gazellemq::server {
             isDisconnected = true;
         };
 
+        /**
+         * Marks [fd] as an index into the ring's registered file table rather than a regular file descriptor
+         * @param b
+         */
+        void setIsDirectDescriptor(bool b) {
+            isDirectDescriptor = b;
+        }
+
         [[nodiscard]] virtual bool getIsNew() const = 0;
         virtual void setIsNew(bool) = 0;
 
@@ -75,10 +84,7 @@ namespace gazellemq::server {
 
             switch (event) {
                 case Enums::Event::Event_NotSet:
-                    beginMakeNonblockingSocket(ring, res);
-                    break;
-                case Enums::Event::Event_SetNonblockingPublisher:
-                    onMakeNonblockingSocketComplete(ring, res);
+                    onConnected(ring);
                     break;
                 case Enums::Event::Event_ReceiveIntent:
                     onIntentReceived(ring, res);
@@ -109,17 +115,30 @@ namespace gazellemq::server {
             printf("%s\n%s\n", msg, strerror(-err));
         }
 
+        /**
+         * Points the sqe at this connection's registered file, when it has one
+         * @param sqe
+         */
+        void setFdFlags(io_uring_sqe* sqe) const {
+            if (isDirectDescriptor) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
+        }
+
         /**
          * Disconnects from the server
          * @param ring
          */
         void beginDisconnect(struct io_uring* ring) {
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
-            io_uring_prep_close(sqe, fd);
+            io_uring_sqe* sqe = getSqe(ring);
+            if (isDirectDescriptor) {
+                io_uring_prep_close_direct(sqe, fd);
+            } else {
+                io_uring_prep_close(sqe, fd);
+            }
             io_uring_sqe_set_data(sqe, this);
 
             event = Enums::Event::Event_Disconnected;
-            io_uring_submit(ring);
         }
 
         virtual void onDisconnected (int res) {
@@ -128,38 +147,14 @@ namespace gazellemq::server {
         }
 
         /**
-         * Sets the client connection to non blocking
+         * The connection was accepted, this client must now indicate whether it is a publisher or subscriber
          * @param ring
-         * @param epfd
          */
-        void beginMakeNonblockingSocket(struct io_uring* ring, int epfd) {
+        virtual void onConnected(struct io_uring* ring) {
             setIsNew(false);
 
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
-            struct epoll_event ev{};
-            ev.events = EPOLLIN | EPOLLOUT;
-            ev.data.fd = fd;
-            io_uring_prep_epoll_ctl(sqe, epfd, fd, EPOLL_CTL_ADD, &ev);
-            io_uring_sqe_set_data(sqe, this);
-
-            event = Enums::Event::Event_SetNonblockingPublisher;
-            io_uring_submit(ring);
-        }
-
-        /**
-         * This client must now indicate whether it is a publisher or subscriber
-         * @param ring
-         * @param res
-         */
-        virtual void onMakeNonblockingSocketComplete(struct io_uring* ring, int res) {
-            if (res < 0) {
-                printError(__PRETTY_FUNCTION__ , res);
-                beginDisconnect(ring);
-            } else {
-
-                // client must communicate with server
-                this->beginReceiveIntent(ring);
-            }
+            // client must communicate with server
+            this->beginReceiveIntent(ring);
         }
 
         /**
@@ -167,13 +162,13 @@ namespace gazellemq::server {
          * @param ring
          */
         void beginReceiveIntent(struct io_uring* ring) {
-            memset(readBuffer, 0, MAX_READ_BUF);
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
+            memset(readBuffer, 0, MAX_HANDSHAKE_BUF);
+            io_uring_sqe* sqe = getSqe(ring);
             io_uring_prep_recv(sqe, fd, readBuffer, 2, 0);
+            setFdFlags(sqe);
             io_uring_sqe_set_data(sqe, this);
 
             event = Enums::Event::Event_ReceiveIntent;
-            io_uring_submit(ring);
         }
 
         /**
@@ -193,7 +188,7 @@ namespace gazellemq::server {
                     beginReceiveIntent(ring);
                 } else {
                     // now receive the name from the client
-                    memset(readBuffer, 0, MAX_READ_BUF);
+                    memset(readBuffer, 0, MAX_HANDSHAKE_BUF);
                     beginReceiveName(ring);
                 }
             }
@@ -204,13 +199,13 @@ namespace gazellemq::server {
          * @param ring
          */
         void beginReceiveName(struct io_uring *ring) {
-            memset(readBuffer, 0, MAX_READ_BUF);
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
-            io_uring_prep_recv(sqe, fd, readBuffer, MAX_READ_BUF, 0);
+            memset(readBuffer, 0, MAX_HANDSHAKE_BUF);
+            io_uring_sqe* sqe = getSqe(ring);
+            io_uring_prep_recv(sqe, fd, readBuffer, MAX_HANDSHAKE_BUF, 0);
+            setFdFlags(sqe);
             io_uring_sqe_set_data(sqe, this);
 
             event = Enums::Event_ReceiveName;
-            io_uring_submit(ring);
         }
 
         /**
@@ -243,12 +238,12 @@ namespace gazellemq::server {
          * @param ring
          */
         void beginSendAck(struct io_uring *ring) {
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
+            io_uring_sqe* sqe = getSqe(ring);
             io_uring_prep_send(sqe, fd, "\r", 1, 0);
+            setFdFlags(sqe);
             io_uring_sqe_set_data(sqe, this);
 
             event = Enums::Event_SendAck;
-            io_uring_submit(ring);
         }
 
         void onSendAckComplete(struct io_uring *ring, int res) {
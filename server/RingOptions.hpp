@@ -0,0 +1,31 @@
+#ifndef GAZELLEMQ_SERVER_RINGOPTIONS_HPP
+#define GAZELLEMQ_SERVER_RINGOPTIONS_HPP
+
+#include "Consts.hpp"
+
+namespace gazellemq::server {
+    /**
+     * How a server's io_uring is set up. Flags the kernel does not support are dropped when the ring is created.
+     */
+    struct RingOptions {
+        // number of submission queue entries, the completion queue is CQ_ENTRIES_PER_SQE times bigger
+        unsigned int queueDepth{DEFAULT_RING_DEPTH};
+
+        // a kernel thread polls the submission queue, so submitting does not need a system call
+        bool sqPoll{false};
+
+        // the CPU the polling thread is pinned to, or -1 to let the kernel choose
+        int sqThreadCpu{-1};
+
+        // how long the polling thread spins without work before it sleeps
+        unsigned int sqThreadIdleMs{DEFAULT_SQ_THREAD_IDLE_MS};
+
+        // only the loop thread submits, which lets the kernel skip some locking
+        bool singleIssuer{true};
+
+        // completions are only processed when the loop waits for them, instead of interrupting it
+        bool deferTaskrun{true};
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_RINGOPTIONS_HPP
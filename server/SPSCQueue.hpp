@@ -0,0 +1,89 @@
+#ifndef GAZELLEMQ_SERVER_SPSCQUEUE_HPP
+#define GAZELLEMQ_SERVER_SPSCQUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <vector>
+
+namespace gazellemq::server {
+    /**
+     * A fixed size FIFO between one producer thread and one consumer thread. Each side only writes its own index, on
+     * its own cache line, and keeps a copy of the other side's index so it only reads it when the queue looks full or
+     * empty.
+     */
+    template<typename T>
+    class SPSCQueue {
+    private:
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+
+        std::vector<T> items;
+        size_t mask{};
+
+        // written by the consumer
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{};
+        size_t cachedTail{};
+
+        // written by the producer
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{};
+        size_t cachedHead{};
+    public:
+        /**
+         * @param capacity Rounded up to a power of 2
+         */
+        explicit SPSCQueue(size_t capacity)
+            : items(std::bit_ceil(std::max<size_t>(capacity, 1))),
+              mask(items.size() - 1)
+        {}
+    public:
+        /**
+         * Returns true if the queue is full. Only called by the producer.
+         * @return
+         */
+        [[nodiscard]] bool full() {
+            size_t const t{tail.load(std::memory_order_relaxed)};
+            if (t - cachedHead == items.size()) {
+                cachedHead = head.load(std::memory_order_acquire);
+            }
+            return t - cachedHead == items.size();
+        }
+
+        /**
+         * Adds an item at the back. Only called by the producer.
+         * @param item
+         * @return false if the queue is full
+         */
+        bool try_push(T&& item) {
+            if (full()) {
+                return false;
+            }
+
+            size_t const t{tail.load(std::memory_order_relaxed)};
+            items[t & mask] = std::move(item);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Removes the item at the front. Only called by the consumer.
+         * @param item
+         * @return false if the queue is empty
+         */
+        bool try_pop(T& item) {
+            size_t const h{head.load(std::memory_order_relaxed)};
+            if (h == cachedTail) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (h == cachedTail) {
+                    return false;
+                }
+            }
+
+            item = std::move(items[h & mask]);
+            items[h & mask] = T{};
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_SPSCQUEUE_HPP
@@ -1,22 +1,42 @@
 #ifndef SERVERCONTEXT_HPP
 #define SERVERCONTEXT_HPP
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Enums.hpp"
 
 namespace gazellemq::server {
+    class MessageLog;
+
+    /**
+     * How the messages of a subscription are delivered
+     */
+    struct SubscriptionOptions {
+        // what happens when the subscriber's send queue is full
+        Enums::SlowConsumerPolicy policy{Enums::SlowConsumer_Disconnect};
+
+        // a waiting batch is replaced by a newer batch of the same message type, instead of both being sent
+        bool conflate{false};
+    };
+
     struct PendingSubscription {
         std::string name;
         std::string subscription;
         unsigned long timeoutMs{};
+        SubscriptionOptions options{};
 
     private:
         void move(PendingSubscription&& other) {
             name = std::move(other.name);
             subscription = std::move(other.subscription);
             timeoutMs = other.timeoutMs;
+            options = other.options;
         }
 
     public:
-        PendingSubscription(std::string name, std::string subscription, unsigned long timeoutMs)
-            : name(std::move(name)), subscription(std::move(subscription)), timeoutMs(timeoutMs) {}
+        PendingSubscription(std::string name, std::string subscription, unsigned long timeoutMs, SubscriptionOptions const& options)
+            : name(std::move(name)), subscription(std::move(subscription)), timeoutMs(timeoutMs), options(options) {}
 
         PendingSubscription(PendingSubscription&& other) noexcept {
             move(std::move(other));
@@ -33,13 +53,42 @@ namespace gazellemq::server {
 
     class ServerContext {
     private:
+        std::mutex mPendingSubscriptions;
         std::vector<PendingSubscription> pendingSubscriptions;
+        Enums::SlowConsumerPolicy defaultSlowConsumerPolicy{Enums::SlowConsumer_Disconnect};
+        MessageLog* messageLog{nullptr};
     public:
-        void addPendingSubscriptions(unsigned long timeoutMs, std::string &&name, std::string &&subscriptions) {
-            pendingSubscriptions.emplace_back(std::move(name), std::move(subscriptions), timeoutMs);
+        /**
+         * The log that replays are served from, or nullptr when batches are not logged
+         * @param messageLog
+         */
+        void setMessageLog(MessageLog* messageLog) {
+            this->messageLog = messageLog;
+        }
+
+        [[nodiscard]] MessageLog* getMessageLog() const {
+            return messageLog;
+        }
+
+        /**
+         * The policy of subscriptions that do not name one. Must be set before the servers start.
+         * @param policy
+         */
+        void setDefaultSlowConsumerPolicy(Enums::SlowConsumerPolicy policy) {
+            defaultSlowConsumerPolicy = policy;
+        }
+
+        [[nodiscard]] Enums::SlowConsumerPolicy getDefaultSlowConsumerPolicy() const {
+            return defaultSlowConsumerPolicy;
+        }
+
+        void addPendingSubscriptions(unsigned long timeoutMs, std::string &&name, std::string &&subscriptions, SubscriptionOptions const& options) {
+            std::lock_guard lock{mPendingSubscriptions};
+            pendingSubscriptions.emplace_back(std::move(name), std::move(subscriptions), timeoutMs, options);
         }
 
         std::vector<PendingSubscription> takePendingSubscriptions(std::string const& clientName) {
+            std::lock_guard lock{mPendingSubscriptions};
             std::vector<PendingSubscription> dest;
             for (PendingSubscription& pendingSubscription : pendingSubscriptions) {
                 if (pendingSubscription.name == clientName) {
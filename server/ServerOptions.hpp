@@ -0,0 +1,113 @@
+#ifndef GAZELLEMQ_SERVER_SERVEROPTIONS_HPP
+#define GAZELLEMQ_SERVER_SERVEROPTIONS_HPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "Consts.hpp"
+#include "BatchPolicy.hpp"
+#include "Enums.hpp"
+#include "MessageQueueOptions.hpp"
+#include "RingOptions.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Deployment settings. Each one can be overridden with a GAZELLEMQ_* environment variable.
+     */
+    struct ServerOptions {
+        unsigned int nbSubscriberThreads{std::max(1u, DEFAULT_NB_THREADS)};
+
+        // every publisher loop has a queue to every subscriber loop, so there are fewer of them by default
+        unsigned int nbPublisherThreads{std::max(1u, DEFAULT_NB_THREADS / 4)};
+        RingOptions ring{};
+        MessageQueueOptions messageQueue{};
+        BatchPolicy batch{};
+
+        // subscriber sends of at least this many bytes use zero copy, 0 turns zero copy sends off
+        size_t zeroCopyThreshold{};
+
+        // how many batches a subscriber can have waiting, and what happens to the ones that do not fit
+        size_t subscriberQueueDepth{DEFAULT_SUBSCRIBER_QUEUE_DEPTH};
+        Enums::SlowConsumerPolicy slowConsumerPolicy{Enums::SlowConsumer_Disconnect};
+
+        // published batches are logged to this directory when it is set
+        std::string logDir{};
+        size_t logSegmentSize{DEFAULT_LOG_SEGMENT_SIZE};
+
+        // the log is fsync'd in groups that are at most this old or this big
+        bool logDurable{false};
+        unsigned long logCommitUs{DEFAULT_LOG_COMMIT_US};
+        size_t logCommitBytes{DEFAULT_LOG_COMMIT_BYTES};
+    public:
+        /**
+         * Returns the options, overridden by whatever is set in the environment
+         * @return
+         */
+        static ServerOptions fromEnvironment() {
+            ServerOptions retVal{};
+            retVal.nbSubscriberThreads = static_cast<unsigned int>(std::max(1l, getEnv("GAZELLEMQ_SUBSCRIBER_THREADS", retVal.nbSubscriberThreads)));
+            retVal.nbPublisherThreads = static_cast<unsigned int>(std::max(1l, getEnv("GAZELLEMQ_PUBLISHER_THREADS", retVal.nbPublisherThreads)));
+
+            retVal.ring.queueDepth = static_cast<unsigned int>(std::max(8l, getEnv("GAZELLEMQ_RING_DEPTH", retVal.ring.queueDepth)));
+            retVal.ring.sqPoll = getEnv("GAZELLEMQ_SQPOLL", retVal.ring.sqPoll) != 0;
+            retVal.ring.sqThreadCpu = static_cast<int>(getEnv("GAZELLEMQ_SQPOLL_CPU", retVal.ring.sqThreadCpu));
+            retVal.ring.sqThreadIdleMs = static_cast<unsigned int>(getEnv("GAZELLEMQ_SQPOLL_IDLE_MS", retVal.ring.sqThreadIdleMs));
+            retVal.ring.singleIssuer = getEnv("GAZELLEMQ_SINGLE_ISSUER", retVal.ring.singleIssuer) != 0;
+            retVal.ring.deferTaskrun = getEnv("GAZELLEMQ_DEFER_TASKRUN", retVal.ring.deferTaskrun) != 0;
+
+            retVal.messageQueue.depth = static_cast<size_t>(std::max(2l, getEnv("GAZELLEMQ_MESSAGE_QUEUE_DEPTH", static_cast<long>(retVal.messageQueue.depth))));
+            retVal.messageQueue.maxQueuedBytes = static_cast<size_t>(std::max(1l, getEnv("GAZELLEMQ_MAX_QUEUED_BYTES", static_cast<long>(retVal.messageQueue.maxQueuedBytes))));
+
+            retVal.batch.maxBytes = static_cast<size_t>(std::max(1l, getEnv("GAZELLEMQ_BATCH_MAX_BYTES", static_cast<long>(retVal.batch.maxBytes))));
+            retVal.batch.maxMessages = static_cast<unsigned int>(std::max(1l, getEnv("GAZELLEMQ_BATCH_MAX_MESSAGES", retVal.batch.maxMessages)));
+            retVal.batch.lingerUs = static_cast<unsigned long>(std::max(0l, getEnv("GAZELLEMQ_BATCH_LINGER_US", static_cast<long>(retVal.batch.lingerUs))));
+            retVal.batch.maxOpenBatches = static_cast<size_t>(std::max(1l, getEnv("GAZELLEMQ_BATCH_MAX_OPEN", static_cast<long>(retVal.batch.maxOpenBatches))));
+
+            retVal.zeroCopyThreshold = static_cast<size_t>(std::max(0l, getEnv("GAZELLEMQ_ZEROCOPY_THRESHOLD", 0)));
+
+            retVal.subscriberQueueDepth = static_cast<size_t>(std::max(1l, getEnv("GAZELLEMQ_SUBSCRIBER_QUEUE_DEPTH", static_cast<long>(retVal.subscriberQueueDepth))));
+            char const* policy{std::getenv("GAZELLEMQ_SLOW_CONSUMER_POLICY")};
+            if (policy != nullptr && !Enums::parseSlowConsumerPolicy(policy, retVal.slowConsumerPolicy)) {
+                std::cerr << "Invalid value for GAZELLEMQ_SLOW_CONSUMER_POLICY (" << policy << ")" << std::endl;
+            }
+
+            char const* logDir{std::getenv("GAZELLEMQ_LOG_DIR")};
+            retVal.logDir = logDir == nullptr ? "" : logDir;
+            retVal.logSegmentSize = static_cast<size_t>(std::max(1048576l, getEnv("GAZELLEMQ_LOG_SEGMENT_SIZE", static_cast<long>(retVal.logSegmentSize))));
+            retVal.logDurable = getEnv("GAZELLEMQ_LOG_DURABLE", retVal.logDurable) != 0;
+            retVal.logCommitUs = static_cast<unsigned long>(std::max(0l, getEnv("GAZELLEMQ_LOG_COMMIT_US", static_cast<long>(retVal.logCommitUs))));
+            retVal.logCommitBytes = static_cast<size_t>(std::max(1l, getEnv("GAZELLEMQ_LOG_COMMIT_BYTES", static_cast<long>(retVal.logCommitBytes))));
+
+            if (!retVal.logDir.empty()) {
+                // a batch is at most its size limit plus one message, so with both at half a segment it always fits
+                retVal.batch.maxBytes = std::min(retVal.batch.maxBytes, retVal.logSegmentSize / 2);
+                retVal.batch.maxMessageBytes = retVal.logSegmentSize / 2;
+            }
+            return retVal;
+        }
+    private:
+        /**
+         * Returns the numeric value of the environment variable, or the default value if it is not set or not a number
+         * @param name
+         * @param defaultValue
+         * @return
+         */
+        static long getEnv(char const* name, long defaultValue) {
+            char const* value{std::getenv(name)};
+            if (value == nullptr) {
+                return defaultValue;
+            }
+
+            try {
+                return std::stol(value);
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid value for " << name << " (" << value << ")" << std::endl;
+                return defaultValue;
+            }
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_SERVEROPTIONS_HPP
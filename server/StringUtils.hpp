@@ -1,10 +1,15 @@
 #ifndef GAZELLEMQ_SERVER_STRINGUTILS_HPP
 #define GAZELLEMQ_SERVER_STRINGUTILS_HPP
 
+#include <bit>
 #include <string>
 #include <vector>
 #include <cstring>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace gazellemq::utils {
     static constexpr auto TO_LOWER_CHAR_MATCH = [](unsigned char a, unsigned char b) {
         return std::tolower(a) == std::tolower(b);
@@ -33,6 +38,44 @@ namespace gazellemq::utils {
         return haystackLen >= needleLen && compare({haystack, needleLen}, {needle, needleLen});
     }
 
+    /**
+     * Returns the position of the first [ch] in [data], or [length] if there is none. Compares 32 bytes at a time
+     * with AVX2, or 16 with SSE2, when the build targets them.
+     * @param data
+     * @param length
+     * @param ch
+     * @return
+     */
+    static size_t findChar(char const* data, size_t length, char const ch) {
+        size_t i{};
+#if defined(__AVX2__)
+        __m256i const needle32{_mm256_set1_epi8(ch)};
+        for (; i + 32 <= length; i += 32) {
+            __m256i const chunk{_mm256_loadu_si256(reinterpret_cast<__m256i const*>(&data[i]))};
+            auto const mask{static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle32)))};
+            if (mask != 0) {
+                return i + std::countr_zero(mask);
+            }
+        }
+#endif
+#if defined(__SSE2__)
+        __m128i const needle16{_mm_set1_epi8(ch)};
+        for (; i + 16 <= length; i += 16) {
+            __m128i const chunk{_mm_loadu_si128(reinterpret_cast<__m128i const*>(&data[i]))};
+            auto const mask{static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle16)))};
+            if (mask != 0) {
+                return i + std::countr_zero(mask);
+            }
+        }
+#endif
+        for (; i < length; ++i) {
+            if (data[i] == ch) {
+                return i;
+            }
+        }
+        return length;
+    }
+
     /**
      * Splits a string
      * @param input
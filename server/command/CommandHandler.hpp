@@ -1,14 +1,14 @@
 #ifndef COMMANDHANDLER_HPP
 #define COMMANDHANDLER_HPP
 #include "../PubSubHandler.hpp"
-#include "../subscriber/SubscriberServer.hpp"
+#include "../subscriber/ShardedSubscriberServer.hpp"
 
 namespace gazellemq::server {
     class CommandHandler final : public PubSubHandler {
     private:
         bool isNew{true};
         std::string command;
-        SubscriberServer* subscriberServer{nullptr};
+        ShardedSubscriberServer* subscriberServer{nullptr};
     public:
         CommandHandler(int const fd, ServerContext* serverContext) :
             PubSubHandler(fd, serverContext)
@@ -29,7 +29,7 @@ namespace gazellemq::server {
             setDisconnected();
         }
     public:
-        void setSubscriberServer(SubscriberServer* subscriberServer) {
+        void setSubscriberServer(ShardedSubscriberServer* subscriberServer) {
             this->subscriberServer = subscriberServer;
         }
 
@@ -42,13 +42,13 @@ namespace gazellemq::server {
         }
 
         void beginReceiveData(struct io_uring* ring) {
-            memset(readBuffer, 0, MAX_READ_BUF);
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
-            io_uring_prep_recv(sqe, fd, readBuffer, MAX_READ_BUF, 0);
+            memset(readBuffer, 0, MAX_HANDSHAKE_BUF);
+            io_uring_sqe* sqe = getSqe(ring);
+            io_uring_prep_recv(sqe, fd, readBuffer, MAX_HANDSHAKE_BUF, 0);
+            setFdFlags(sqe);
             io_uring_sqe_set_data(sqe, this);
 
             event = Enums::Event_ReceivePublisherData;
-            io_uring_submit(ring);
         }
 
         /**
@@ -84,11 +84,12 @@ namespace gazellemq::server {
                 std::vector<std::string> values;
                 utils::split(std::string{command}, values, '|');
 
-                if (values.size() == 4) {
+                if (values.size() == 4 || values.size() == 5) {
                     std::string name{values.at(0)};
                     std::string type{values.at(1)};
                     std::string value{values.at(2)};
                     unsigned long timeoutMs{0};
+                    SubscriptionOptions options{serverContext->getDefaultSlowConsumerPolicy()};
 
                     try {
                         timeoutMs = std::stoull(values.at(3));
@@ -100,8 +101,15 @@ namespace gazellemq::server {
                         std::cerr << "[" << clientName << "] " << e.what() << std::endl;
                     }
 
+                    if (values.size() == 5) {
+                        parseSubscriptionOptions(values.at(4), options);
+                    }
+
                     if (type == "subscribe") {
-                        addSubscription(timeoutMs, std::move(name), std::move(value));
+                        addSubscription(timeoutMs, std::move(name), std::move(value), options);
+                    } else if (type == "replay" || type == "replay-time") {
+                        // the fourth field is the offset or the timestamp to replay from
+                        replay(name, value, type == "replay-time", timeoutMs);
                     }
                 } else {
                     std::cerr << "Invalid command (" << command << ")" << std::endl;
@@ -111,19 +119,64 @@ namespace gazellemq::server {
             commands.clear();
         }
 
-        void addSubscription(unsigned long timeoutMs, std::string &&name, std::string &&subscriptions) const {
+        /**
+         * Reads the comma separated options of a subscribe command, a slow consumer policy and/or "conflate"
+         * @param optionsCsv
+         * @param options
+         */
+        void parseSubscriptionOptions(std::string const& optionsCsv, SubscriptionOptions& options) const {
+            std::vector<std::string> optionValues;
+            utils::split(std::string{optionsCsv}, optionValues);
+
+            for (std::string const& optionValue : optionValues) {
+                if (optionValue == "conflate") {
+                    options.conflate = true;
+                } else if (!Enums::parseSlowConsumerPolicy(optionValue, options.policy)) {
+                    std::cerr << "[" << clientName << "] unknown subscription option (" << optionValue << ")" << std::endl;
+                }
+            }
+        }
+
+        /**
+         * Asks a connected subscriber to replay the logged messages of the topics
+         * @param name
+         * @param topicsCsv
+         * @param isTimestamp
+         * @param from
+         */
+        void replay(std::string const& name, std::string const& topicsCsv, bool isTimestamp, unsigned long from) const {
+            std::vector<std::string> topics;
+            utils::split(std::string{topicsCsv}, topics);
+
+            bool wasFound{false};
+            for (PubSubHandler *pubSubHandler : subscriberServer->getClients()) {
+                auto client = dynamic_cast<TCPSubscriberHandler*>(pubSubHandler);
+                if ((client->getClientName() == name) && (!client->getIsDisconnected())) {
+                    for (std::string const& topic : topics) {
+                        client->postReplay(ReplayRequest{topic, isTimestamp, from});
+                    }
+                    wasFound = true;
+                }
+            }
+
+            if (!wasFound) {
+                std::cerr << "[" << clientName << "] cannot replay, subscriber " << name << " is not connected" << std::endl;
+            }
+        }
+
+        void addSubscription(unsigned long timeoutMs, std::string &&name, std::string &&subscriptions, SubscriptionOptions const& options) const {
             bool wasFound{false};
             for (PubSubHandler *pubSubHandler : subscriberServer->getClients()) {
                 auto client = dynamic_cast<TCPSubscriberHandler*>(pubSubHandler);
                 if ((client->getClientName() == name) && (!client->getIsDisconnected())) {
-                    client->addSubscriptions(timeoutMs, subscriptions);
+                    client->postSubscriptions(timeoutMs, subscriptions, options);
                     wasFound = true;
                 }
             }
 
             if (!wasFound) {
                 // to get here means the subscriber probably just hasn't connected yet
-                serverContext->addPendingSubscriptions(timeoutMs, std::move(name), std::move(subscriptions));
+                serverContext->addPendingSubscriptions(timeoutMs, std::move(name), std::move(subscriptions), options);
             }
         }
     public:
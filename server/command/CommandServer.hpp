@@ -6,11 +6,11 @@
 namespace gazellemq::server {
     class CommandServer final : public BaseServer {
     private:
-        SubscriberServer* subscriberServer;
+        ShardedSubscriberServer* subscriberServer;
     public:
         CommandServer(
             int const port,
-            SubscriberServer* subscriberServer,
+            ShardedSubscriberServer* subscriberServer,
             ServerContext* serverContext,
             std::atomic_flag& isRunning,
             std::function<PubSubHandler* (int, ServerContext*)>&& createFn
@@ -25,43 +25,15 @@ namespace gazellemq::server {
         void afterConnectionAccepted(struct io_uring *ring, PubSubHandler* pubSubHandler) override {
             auto connection = dynamic_cast<CommandHandler*>(pubSubHandler);
             connection->setSubscriberServer(subscriberServer);
-            connection->handleEvent(ring, epfd);
-        }
-
-        static void eventLoop(io_uring* ring, std::vector<io_uring_cqe*>& cqes, __kernel_timespec& ts) {
-            const int ret = io_uring_wait_cqe_timeout(ring, cqes.data(), &ts);
-            if (ret == -SIGILL || ret == TIMEOUT) {
-                return;
-            }
-
-            if (ret < 0) {
-                printError("io_uring_wait_cqe_timeout(...)", ret);
-                exit(0);
-            }
-
-            std::ranges::for_each(cqes, [&ring](io_uring_cqe* cqe) {
-                if (cqe != nullptr) {
-                    int res = cqe->res;
-                    if (res != -EAGAIN) {
-                        auto *pSubscriber = static_cast<BaseObject *>(io_uring_cqe_get_data(cqe));
-                        pSubscriber->handleEvent(ring, res);
-                    }
-                    io_uring_cqe_seen(ring, cqe);
-                }
-            });
+            connection->handleEvent(ring, 0);
         }
 
         void doEventLoop(io_uring* ring) override {
-            constexpr static size_t NB_EVENTS = 32;
-
-            std::vector<io_uring_cqe*> cqes{};
-            cqes.reserve(NB_EVENTS);
-            cqes.insert(cqes.begin(), NB_EVENTS, nullptr);
-
             __kernel_timespec ts{.tv_sec = 1, .tv_nsec = 0};
 
             while (isRunning.test()) {
-                eventLoop(ring, cqes, ts);
+                processCompletions(ring, ts);
+                retryAccept(ring);
 
                 // removeDisconnectedClients();
             }
@@ -72,9 +44,6 @@ namespace gazellemq::server {
                 case Enums::Event::Event_NotSet:
                     beginSetupListenerSocket(ring);
                     break;
-                case Enums::Event::Event_SetupPublisherListeningSocket:
-                    onSetupListeningSocketComplete(ring, res);
-                    break;
                 case Enums::Event::Event_AcceptPublisherConnection:
                     onAcceptConnectionComplete(ring, res);
                     break;
@@ -0,0 +1,130 @@
+#ifndef GAZELLEMQ_SERVER_GROUPCOMMIT_HPP
+#define GAZELLEMQ_SERVER_GROUPCOMMIT_HPP
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "../BaseObject.hpp"
+#include "../MessageBatch.hpp"
+#include "../publisher/PublisherAcks.hpp"
+#include "LogSegment.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Makes logged batches durable in groups. One fsync per segment that was written to covers every batch appended
+     * since the previous group, and the publishers of those batches are acknowledged when the fsyncs complete. A group
+     * is committed once it is old enough or big enough, and only one group is synced at a time.
+     */
+    class GroupCommit final : public BaseObject {
+    private:
+        struct PendingAck {
+            std::shared_ptr<PublisherAcks> acks;
+            unsigned int nbMessages{};
+        };
+
+        std::chrono::microseconds maxDelay;
+        size_t maxBytes;
+
+        // the group being filled
+        std::vector<PendingAck> pendingAcks;
+        std::vector<LogSegment*> pendingSegments;
+        size_t nbPendingBytes{};
+        std::chrono::steady_clock::time_point firstPendingTime{};
+
+        // the group being synced
+        std::vector<PendingAck> syncingAcks;
+        unsigned int nbSyncsInFlight{};
+    public:
+        /**
+         * @param maxDelay How long a batch can wait for its group to be committed
+         * @param maxBytes How many bytes a group can hold before it is committed
+         */
+        GroupCommit(std::chrono::microseconds maxDelay, size_t maxBytes)
+            : maxDelay(maxDelay),
+              maxBytes(maxBytes)
+        {}
+    public:
+        /**
+         * Adds a batch that was just appended to the segment to the current group
+         * @param segment
+         * @param batch
+         */
+        void add(LogSegment* segment, MessageBatch const& batch) {
+            if (nbPendingBytes == 0) {
+                firstPendingTime = std::chrono::steady_clock::now();
+            }
+            nbPendingBytes += batch.getBufferLength();
+
+            if (std::ranges::find(pendingSegments, segment) == pendingSegments.end()) {
+                pendingSegments.push_back(segment);
+            }
+
+            if (batch.getAcks() != nullptr) {
+                pendingAcks.push_back(PendingAck{batch.getAcks(), batch.getNbMessages()});
+            }
+        }
+
+        /**
+         * Starts syncing the current group if it is due and the previous one is done
+         * @param ring
+         */
+        void maybeCommit(io_uring* ring) {
+            if (nbSyncsInFlight > 0 || nbPendingBytes == 0) {
+                return;
+            }
+
+            if (nbPendingBytes < maxBytes && std::chrono::steady_clock::now() - firstPendingTime < maxDelay) {
+                return;
+            }
+
+            for (LogSegment* segment : pendingSegments) {
+                for (int const fd : {segment->getDataFd(), segment->getIndexFd()}) {
+                    io_uring_sqe* sqe = getSqe(ring);
+                    io_uring_prep_fsync(sqe, fd, IORING_FSYNC_DATASYNC);
+                    io_uring_sqe_set_data(sqe, this);
+                    ++nbSyncsInFlight;
+                }
+            }
+
+            syncingAcks.swap(pendingAcks);
+            pendingSegments.clear();
+            nbPendingBytes = 0;
+        }
+
+        /**
+         * Returns how long the loop can wait before the current group is due. While a group is being synced the loop
+         * is woken by its completions instead.
+         * @return
+         */
+        [[nodiscard]] __kernel_timespec getTimeout() const {
+            auto delay{std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::seconds{1})};
+            if (nbPendingBytes > 0 && nbSyncsInFlight == 0) {
+                delay = std::max(std::chrono::nanoseconds{0}, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        maxDelay - (std::chrono::steady_clock::now() - firstPendingTime)));
+            }
+
+            return __kernel_timespec{
+                .tv_sec = delay.count() / 1000000000,
+                .tv_nsec = delay.count() % 1000000000
+            };
+        }
+
+        void handleEvent(io_uring* ring, int res) override {
+            if (res < 0) {
+                // after a failed fsync the page cache can no longer be trusted to match the disk
+                printf("%s\n%s\n", "GroupCommit::handleEvent", strerror(-res));
+                exit(1);
+            }
+
+            if (--nbSyncsInFlight == 0) {
+                for (PendingAck const& pendingAck : syncingAcks) {
+                    pendingAck.acks->onCommitted(pendingAck.nbMessages);
+                }
+                syncingAcks.clear();
+            }
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_GROUPCOMMIT_HPP
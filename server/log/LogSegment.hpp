@@ -0,0 +1,228 @@
+#ifndef GAZELLEMQ_SERVER_LOGSEGMENT_HPP
+#define GAZELLEMQ_SERVER_LOGSEGMENT_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace gazellemq::server {
+    /**
+     * Where a batch was written in a segment. The entries are stored in the .idx file next to the segment.
+     */
+    struct LogIndexEntry {
+        // offset of the first message of the batch, offsets count messages from the start of the topic
+        uint64_t offset;
+        uint64_t timestampMs;
+
+        // where the batch starts in the .log file
+        uint64_t position;
+        uint32_t length;
+        uint32_t nbMessages;
+    };
+
+    /**
+     * One file of a topic's log and its index, both mapped into memory. Only the log's writer thread appends. Other
+     * threads only read the entries counted by getNbEntries(), whose bytes are never modified again.
+     */
+    class LogSegment {
+    private:
+        // the index of a new segment has room for one entry per this many bytes of log. A segment of smaller batches
+        // is full once its index is.
+        static constexpr size_t MIN_AVG_BATCH_LENGTH = 512;
+
+        uint64_t baseOffset;
+        size_t capacity{};
+        size_t indexCapacity{};
+        int dataFd{-1};
+        int indexFd{-1};
+        char* data{nullptr};
+        LogIndexEntry* index{nullptr};
+        size_t writePosition{};
+        std::atomic<size_t> nbEntries{};
+    public:
+        /**
+         * Opens the segment, creating it if it does not exist. A segment that exists keeps the size it was created with,
+         * and the entries that are already in its index are kept.
+         * @param path The file name without extension
+         * @param baseOffset Offset of the first message in the segment
+         * @param newCapacity Size of the .log file, if it is created
+         */
+        LogSegment(std::string const& path, uint64_t baseOffset, size_t newCapacity)
+            : baseOffset(baseOffset)
+        {
+            dataFd = openFile(path + ".log", newCapacity, capacity);
+
+            size_t indexSize{};
+            indexFd = openFile(path + ".idx", std::max<size_t>(newCapacity / MIN_AVG_BATCH_LENGTH, 1) * sizeof(LogIndexEntry), indexSize);
+            indexCapacity = indexSize / sizeof(LogIndexEntry);
+
+            data = static_cast<char*>(mapFile(dataFd, capacity));
+            index = static_cast<LogIndexEntry*>(mapFile(indexFd, indexCapacity * sizeof(LogIndexEntry)));
+
+            // an entry that was never written is all zeros
+            size_t n{};
+            while (n < indexCapacity && index[n].length > 0) {
+                ++n;
+            }
+
+            if (n > 0) {
+                writePosition = index[n - 1].position + index[n - 1].length;
+            }
+            nbEntries.store(n, std::memory_order_release);
+        }
+
+        LogSegment(LogSegment const&) = delete;
+        LogSegment& operator=(LogSegment const&) = delete;
+
+        ~LogSegment() {
+            munmap(data, capacity);
+            munmap(index, indexCapacity * sizeof(LogIndexEntry));
+            close(dataFd);
+            close(indexFd);
+        }
+    private:
+        /**
+         * Opens the file, and sizes it if it was just created. Existing files are never resized, shrinking one would
+         * cut off what was logged.
+         * @param path
+         * @param newSize The size of a new file
+         * @param size Set to the size of the file
+         * @return
+         */
+        static int openFile(std::string const& path, size_t newSize, size_t& size) {
+            int const fd{open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)};
+            if (fd < 0) {
+                printf("open(%s): %s\n", path.c_str(), strerror(errno));
+                exit(1);
+            }
+
+            struct stat fileStat{};
+            if (fstat(fd, &fileStat) < 0) {
+                printf("fstat(%s): %s\n", path.c_str(), strerror(errno));
+                exit(1);
+            }
+
+            size = static_cast<size_t>(fileStat.st_size);
+            if (size == 0) {
+                if (ftruncate(fd, static_cast<off_t>(newSize)) < 0) {
+                    printf("ftruncate(%s): %s\n", path.c_str(), strerror(errno));
+                    exit(1);
+                }
+                size = newSize;
+            }
+            return fd;
+        }
+
+        static void* mapFile(int fd, size_t size) {
+            void* retVal{mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)};
+            if (retVal == MAP_FAILED) {
+                printf("%s\n", "mmap(...)");
+                exit(1);
+            }
+            return retVal;
+        }
+    public:
+        /**
+         * Returns the file name, without extension, of the segment that starts at the offset
+         * @param dir
+         * @param baseOffset
+         * @return
+         */
+        static std::string getPath(std::string const& dir, uint64_t baseOffset) {
+            char name[24];
+            snprintf(name, sizeof(name), "%020lu", static_cast<unsigned long>(baseOffset));
+            return dir + "/" + name;
+        }
+
+        /**
+         * Copies the batch to the end of the segment and indexes it
+         * @param bytes
+         * @param length
+         * @param offset
+         * @param nbMessages
+         * @param timestampMs
+         * @return false if the segment is full
+         */
+        bool tryAppend(char const* bytes, size_t length, uint64_t offset, unsigned int nbMessages, uint64_t timestampMs) {
+            size_t const n{nbEntries.load(std::memory_order_relaxed)};
+            if (n == indexCapacity || writePosition + length > capacity) {
+                return false;
+            }
+
+            memcpy(&data[writePosition], bytes, length);
+            index[n] = LogIndexEntry{offset, timestampMs, writePosition, static_cast<uint32_t>(length), nbMessages};
+            writePosition += length;
+
+            // readers can now see the batch
+            nbEntries.store(n + 1, std::memory_order_release);
+            return true;
+        }
+
+        [[nodiscard]] uint64_t getBaseOffset() const {
+            return baseOffset;
+        }
+
+        /**
+         * Returns the offset the next message written to this segment would get
+         * @return
+         */
+        [[nodiscard]] uint64_t getNextOffset() const {
+            size_t const n{getNbEntries()};
+            return n == 0 ? baseOffset : index[n - 1].offset + index[n - 1].nbMessages;
+        }
+
+        [[nodiscard]] size_t getNbEntries() const {
+            return nbEntries.load(std::memory_order_acquire);
+        }
+
+        [[nodiscard]] LogIndexEntry const& getEntry(size_t i) const {
+            return index[i];
+        }
+
+        [[nodiscard]] int getDataFd() const {
+            return dataFd;
+        }
+
+        [[nodiscard]] int getIndexFd() const {
+            return indexFd;
+        }
+
+        [[nodiscard]] char const* getData() const {
+            return data;
+        }
+
+        /**
+         * Returns the first of the n entries that holds the offset or comes after it
+         * @param offset
+         * @param n
+         * @return
+         */
+        [[nodiscard]] size_t findOffset(uint64_t offset, size_t n) const {
+            return std::partition_point(index, index + n, [offset](LogIndexEntry const& o) {
+                return o.offset + o.nbMessages <= offset;
+            }) - index;
+        }
+
+        /**
+         * Returns the first of the n entries written at or after the timestamp
+         * @param timestampMs
+         * @param n
+         * @return
+         */
+        [[nodiscard]] size_t findTimestamp(uint64_t timestampMs, size_t n) const {
+            return std::partition_point(index, index + n, [timestampMs](LogIndexEntry const& o) {
+                return o.timestampMs < timestampMs;
+            }) - index;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_LOGSEGMENT_HPP
@@ -0,0 +1,177 @@
+#ifndef GAZELLEMQ_SERVER_MESSAGELOG_HPP
+#define GAZELLEMQ_SERVER_MESSAGELOG_HPP
+
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+#include "../MessageQueue.hpp"
+#include "GroupCommit.hpp"
+#include "TopicLog.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Keeps every published batch on disk, one log per message type, so subscribers can ask for them again. It is
+     * another consumer of the message bus, with its own thread and ring, so publishers and subscribers never wait on
+     * the disk. In durable mode the segments are fsync'd in groups, and publishers that asked for acks get them once
+     * their messages are committed.
+     */
+    class MessageLog {
+    private:
+        std::string dir;
+        size_t segmentSize;
+        MessageQueue messageQueue{getMessageQueueOptions()};
+        std::atomic_flag& isRunning;
+        std::jthread bgThread;
+        std::unique_ptr<GroupCommit> groupCommit{};
+
+        // the writer thread adds topics, replays look them up from the subscriber threads
+        std::mutex mTopics;
+        std::unordered_map<MessageTypeId, std::unique_ptr<TopicLog>> topics;
+    public:
+        MessageLog(std::string dir, size_t segmentSize, std::atomic_flag& isRunning)
+            : dir(std::move(dir)),
+              segmentSize(segmentSize),
+              isRunning(isRunning)
+        {
+            std::filesystem::create_directories(this->dir);
+            getMessageBus().addQueue(&messageQueue);
+        }
+    public:
+        /**
+         * Turns on durable mode. Must be called before start()
+         * @param maxDelay How long a batch can wait to be fsync'd
+         * @param maxBytes How many bytes can be waiting to be fsync'd
+         */
+        void setDurable(std::chrono::microseconds maxDelay, size_t maxBytes) {
+            groupCommit = std::make_unique<GroupCommit>(maxDelay, maxBytes);
+        }
+
+        void start() {
+            bgThread = std::jthread{[this]() {
+                io_uring ring{};
+                int const ret{io_uring_queue_init(LOG_RING_DEPTH, &ring, 0)};
+                if (ret < 0) {
+                    printf("%s\n%s\n", "io_uring_queue_init(...)", strerror(-ret));
+                    exit(1);
+                }
+
+                std::cout << "Message log started [" << dir << (groupCommit != nullptr ? ", durable" : "") << "]" << std::endl;
+
+                messageQueue.beginWait(&ring);
+                while (isRunning.test()) {
+                    __kernel_timespec ts{groupCommit != nullptr ? groupCommit->getTimeout() : __kernel_timespec{.tv_sec = 1, .tv_nsec = 0}};
+                    BaseObject::processCompletions(&ring, ts);
+
+                    if (messageQueue.takeIsReady()) {
+                        drainQueue();
+                        messageQueue.beginWait(&ring);
+                    }
+
+                    if (groupCommit != nullptr) {
+                        groupCommit->maybeCommit(&ring);
+                    }
+                }
+
+                io_uring_queue_exit(&ring);
+            }};
+        }
+
+        /**
+         * Returns the logged batches of a topic from the requested offset or timestamp onwards. Safe to call from any
+         * thread.
+         * @param request
+         * @return Nothing if the topic was never logged
+         */
+        std::vector<SharedMessageBatch> read(ReplayRequest const& request) {
+            TopicLog* topic{findTopic(request.topic)};
+            if (topic == nullptr) {
+                return {};
+            }
+            return topic->read(request);
+        }
+    private:
+        void drainQueue() {
+            SharedMessageBatch batch;
+            while (messageQueue.try_pop(batch)) {
+                if (batch->getMessageType() == NO_MESSAGE_TYPE) {
+                    continue;
+                }
+
+                uint64_t const timestampMs{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count())};
+                LogSegment* segment{getTopic(batch->getMessageType())->append(*batch, timestampMs)};
+                if (segment == nullptr) {
+                    // already reported, publishers refuse messages that could make a batch too big, see ServerOptions
+                    continue;
+                }
+
+                if (groupCommit != nullptr) {
+                    groupCommit->add(segment, *batch);
+                } else if (batch->getAcks() != nullptr) {
+                    // without durable mode a message is committed once it is in the page cache
+                    batch->getAcks()->onCommitted(batch->getNbMessages());
+                }
+            }
+        }
+
+        /**
+         * Returns the log of the message type, opening it the first time
+         * @param messageType
+         * @return
+         */
+        TopicLog* getTopic(MessageTypeId messageType) {
+            std::lock_guard lock{mTopics};
+            auto& topic{topics[messageType]};
+            if (topic == nullptr) {
+                topic = std::make_unique<TopicLog>(dir + "/" + getDirName(getMessageTypes().getName(messageType)), segmentSize);
+            }
+            return topic.get();
+        }
+
+        /**
+         * Returns the log of the message type if it has one. Names that were never logged are neither interned nor
+         * given a directory, since anyone can send them to the command port.
+         * @param messageType
+         * @return nullptr if the message type was never logged
+         */
+        TopicLog* findTopic(std::string const& messageType) {
+            MessageTypeId const messageTypeId{getMessageTypes().find(messageType)};
+            if (messageTypeId != NO_MESSAGE_TYPE) {
+                std::lock_guard lock{mTopics};
+                auto const it{topics.find(messageTypeId)};
+                if (it != topics.end()) {
+                    return it->second.get();
+                }
+            }
+
+            // a topic logged before a restart is opened the first time it is replayed
+            if (!std::filesystem::is_directory(dir + "/" + getDirName(messageType))) {
+                return nullptr;
+            }
+            return getTopic(getMessageTypes().intern(messageType));
+        }
+
+        /**
+         * Returns a directory name for the message type. Characters that are not safe in a file name are written as
+         * %XX.
+         * @param messageType
+         * @return
+         */
+        static std::string getDirName(std::string const& messageType) {
+            std::string retVal;
+            for (char c : messageType) {
+                if (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || (c == '.' && !retVal.empty())) {
+                    retVal.push_back(c);
+                } else {
+                    char escaped[4];
+                    snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned char>(c));
+                    retVal.append(escaped);
+                }
+            }
+            return retVal;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_MESSAGELOG_HPP
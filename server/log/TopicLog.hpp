@@ -0,0 +1,167 @@
+#ifndef GAZELLEMQ_SERVER_TOPICLOG_HPP
+#define GAZELLEMQ_SERVER_TOPICLOG_HPP
+
+#include <charconv>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../MessageBatch.hpp"
+#include "LogSegment.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Where a replay starts
+     */
+    struct ReplayRequest {
+        std::string topic;
+
+        // from is a timestamp in milliseconds instead of an offset
+        bool isTimestamp{false};
+        uint64_t from{};
+    };
+
+    /**
+     * The log of one message type, a directory of segments named after the offset they start at
+     */
+    class TopicLog {
+    private:
+        std::string dir;
+        size_t segmentSize;
+
+        // only locked to add a segment, or to copy the list for a replay
+        std::mutex mSegments;
+        std::vector<std::shared_ptr<LogSegment>> segments;
+        uint64_t nextOffset{};
+    public:
+        /**
+         * Opens the segments that are already in the directory
+         * @param dir
+         * @param segmentSize
+         */
+        TopicLog(std::string dir, size_t segmentSize)
+            : dir(std::move(dir)),
+              segmentSize(segmentSize)
+        {
+            std::filesystem::create_directories(this->dir);
+
+            std::vector<uint64_t> baseOffsets;
+            for (auto const& file : std::filesystem::directory_iterator{this->dir}) {
+                if (file.path().extension() != ".log") {
+                    continue;
+                }
+
+                // segments are named after their base offset, anything else is not ours
+                std::string const stem{file.path().stem().string()};
+                uint64_t baseOffset{};
+                auto const [ptr, ec]{std::from_chars(stem.data(), stem.data() + stem.size(), baseOffset)};
+                if (ec != std::errc{} || ptr != stem.data() + stem.size()) {
+                    printf("Skipping %s, it is not a log segment\n", file.path().c_str());
+                    continue;
+                }
+                baseOffsets.push_back(baseOffset);
+            }
+            std::ranges::sort(baseOffsets);
+
+            for (uint64_t baseOffset : baseOffsets) {
+                segments.push_back(std::make_shared<LogSegment>(LogSegment::getPath(this->dir, baseOffset), baseOffset, segmentSize));
+            }
+
+            if (!segments.empty()) {
+                nextOffset = segments.back()->getNextOffset();
+            }
+        }
+    public:
+        /**
+         * Appends the batch, starting a new segment when the current one is full. Only called by the writer thread.
+         * @param batch
+         * @param timestampMs
+         * @return The segment the batch was written to, or nullptr if it was not written
+         */
+        LogSegment* append(MessageBatch const& batch, uint64_t timestampMs) {
+            if (batch.getBufferLength() > segmentSize) {
+                printf("Batch of %zu bytes does not fit in a log segment\n", batch.getBufferLength());
+                return nullptr;
+            }
+
+            if (segments.empty() || !segments.back()->tryAppend(batch.getBuffer(), batch.getBufferLength(), nextOffset, batch.getNbMessages(), timestampMs)) {
+                std::string const path{LogSegment::getPath(dir, nextOffset)};
+                if (!segments.empty() && segments.back()->getNbEntries() == 0) {
+                    // an empty segment kept from an earlier run that is too small for the batch, it is replaced so two
+                    // segments never map the same files
+                    std::filesystem::remove(path + ".log");
+                    std::filesystem::remove(path + ".idx");
+
+                    std::lock_guard lock{mSegments};
+                    segments.pop_back();
+                }
+
+                auto segment{std::make_shared<LogSegment>(path, nextOffset, segmentSize)};
+                if (!segment->tryAppend(batch.getBuffer(), batch.getBufferLength(), nextOffset, batch.getNbMessages(), timestampMs)) {
+                    printf("Could not append a batch of %zu bytes to the new log segment %s\n", batch.getBufferLength(), path.c_str());
+                    return nullptr;
+                }
+                syncDir();
+
+                std::lock_guard lock{mSegments};
+                segments.push_back(std::move(segment));
+            }
+
+            nextOffset += batch.getNbMessages();
+            return segments.back().get();
+        }
+    private:
+        /**
+         * Makes the new segment's directory entry durable, it is rare enough to be done inline
+         */
+        void syncDir() const {
+            int const fd{open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+            if (fd >= 0) {
+                fsync(fd);
+                close(fd);
+            }
+        }
+    public:
+        /**
+         * Returns everything written from the requested offset or timestamp onwards, as batches that point into the
+         * mapped segments. A replay starts at the beginning of the batch that holds the requested offset.
+         * @param request
+         * @return
+         */
+        std::vector<SharedMessageBatch> read(ReplayRequest const& request) {
+            std::vector<std::shared_ptr<LogSegment>> segmentsCopy;
+            {
+                std::lock_guard lock{mSegments};
+                segmentsCopy = segments;
+            }
+
+            std::vector<SharedMessageBatch> retVal;
+            for (size_t i{}; i < segmentsCopy.size(); ++i) {
+                std::shared_ptr<LogSegment> const& segment{segmentsCopy[i]};
+
+                // segments that end before the offset are skipped
+                if (!request.isTimestamp && i + 1 < segmentsCopy.size() && segmentsCopy[i + 1]->getBaseOffset() <= request.from) {
+                    continue;
+                }
+
+                size_t const n{segment->getNbEntries()};
+                size_t const first{request.isTimestamp ? segment->findTimestamp(request.from, n) : segment->findOffset(request.from, n)};
+                if (first == n) {
+                    continue;
+                }
+
+                LogIndexEntry const& firstEntry{segment->getEntry(first)};
+                LogIndexEntry const& lastEntry{segment->getEntry(n - 1)};
+                retVal.push_back(std::make_shared<MessageBatch const>(
+                        NO_MESSAGE_TYPE,
+                        &segment->getData()[firstEntry.position],
+                        lastEntry.position + lastEntry.length - firstEntry.position,
+                        segment));
+            }
+            return retVal;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_TOPICLOG_HPP
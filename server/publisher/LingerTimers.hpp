@@ -0,0 +1,68 @@
+#ifndef GAZELLEMQ_SERVER_LINGERTIMERS_HPP
+#define GAZELLEMQ_SERVER_LINGERTIMERS_HPP
+
+#include <chrono>
+#include <queue>
+#include <vector>
+
+namespace gazellemq::server {
+    class TCPPublisherHandler;
+
+    /**
+     * The linger deadlines of a publisher loop's publishers, earliest first, so the loop only visits the publishers
+     * that have a batch due. A publisher can have stale timers, it ignores those that are not its latest one.
+     */
+    class LingerTimers {
+    public:
+        struct Timer {
+            std::chrono::steady_clock::time_point deadline;
+            TCPPublisherHandler* publisher;
+        };
+    private:
+        struct IsLater {
+            bool operator()(Timer const& a, Timer const& b) const {
+                return a.deadline > b.deadline;
+            }
+        };
+
+        std::priority_queue<Timer, std::vector<Timer>, IsLater> timers{};
+    public:
+        /**
+         * Adds a timer for the publisher
+         * @param publisher
+         * @param deadline
+         */
+        void schedule(TCPPublisherHandler* publisher, std::chrono::steady_clock::time_point deadline) {
+            timers.push(Timer{deadline, publisher});
+        }
+
+        /**
+         * Returns true if the earliest timer is due
+         * @param now
+         * @return
+         */
+        [[nodiscard]] bool isDue(std::chrono::steady_clock::time_point now) const {
+            return !timers.empty() && timers.top().deadline <= now;
+        }
+
+        /**
+         * Removes the earliest timer
+         * @return
+         */
+        Timer pop() {
+            Timer const timer{timers.top()};
+            timers.pop();
+            return timer;
+        }
+
+        /**
+         * Returns when the earliest timer is due, or time_point::max() if there is none
+         * @return
+         */
+        [[nodiscard]] std::chrono::steady_clock::time_point getNextDeadline() const {
+            return timers.empty() ? std::chrono::steady_clock::time_point::max() : timers.top().deadline;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_LINGERTIMERS_HPP
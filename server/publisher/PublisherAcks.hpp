@@ -0,0 +1,93 @@
+#ifndef GAZELLEMQ_SERVER_PUBLISHERACKS_HPP
+#define GAZELLEMQ_SERVER_PUBLISHERACKS_HPP
+
+#include <algorithm>
+
+#include "../EventSignal.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Acknowledges a durable publisher's messages, with one '\r' per message, once the message log has committed
+     * them. The log's thread counts the committed messages and the publisher's loop sends the acks, on its own
+     * requests so they do not get mixed up with the publisher's receives.
+     */
+    class PublisherAcks final : public BaseObject {
+    private:
+        static constexpr size_t MAX_ACKS_PER_SEND = 256;
+
+        int fd;
+        bool isDirectDescriptor;
+        EventSignal* signal;
+        char acks[MAX_ACKS_PER_SEND]{};
+
+        std::atomic<uint64_t> nbCommitted{};
+        uint64_t nbAcked{};
+        bool isSending{false};
+        bool isClosed{false};
+    public:
+        /**
+         * @param fd The publisher's socket
+         * @param isDirectDescriptor
+         * @param signal Wakes the publisher's loop when messages are committed
+         */
+        PublisherAcks(int fd, bool isDirectDescriptor, EventSignal* signal)
+            : fd(fd),
+              isDirectDescriptor(isDirectDescriptor),
+              signal(signal)
+        {
+            memset(acks, '\r', MAX_ACKS_PER_SEND);
+        }
+    public:
+        /**
+         * Counts messages as committed and wakes the publisher's loop. Safe to call from any thread.
+         * @param nbMessages
+         */
+        void onCommitted(unsigned int nbMessages) {
+            nbCommitted.fetch_add(nbMessages, std::memory_order_release);
+            signal->notify();
+        }
+
+        /**
+         * Sends the acks of the messages that were committed and not acknowledged yet
+         * @param ring
+         */
+        void sendAcks(io_uring* ring) {
+            if (isClosed || isSending) {
+                return;
+            }
+
+            uint64_t const nbToSend{nbCommitted.load(std::memory_order_acquire) - nbAcked};
+            if (nbToSend == 0) {
+                return;
+            }
+
+            io_uring_sqe* sqe = getSqe(ring);
+            io_uring_prep_send(sqe, fd, acks, std::min<uint64_t>(nbToSend, MAX_ACKS_PER_SEND), 0);
+            if (isDirectDescriptor) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
+            io_uring_sqe_set_data(sqe, this);
+            isSending = true;
+        }
+
+        /**
+         * Stops sending acks, the publisher's socket is going away
+         */
+        void close() {
+            isClosed = true;
+        }
+
+        void handleEvent(io_uring* ring, int res) override {
+            isSending = false;
+            if (res <= 0) {
+                // the publisher is disconnecting, its handler closes the socket
+                return;
+            }
+
+            nbAcked += res;
+            sendAcks(ring);
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_PUBLISHERACKS_HPP
@@ -5,71 +5,132 @@
 
 namespace gazellemq::server {
     class PublisherServer final : public BaseServer {
+    private:
+        static constexpr int READ_BUF_GROUP = 0;
+
+        unsigned int shard;
+
+        // receive buffers shared by every publisher on this ring
+        BufferRing bufferRing{NB_PUBLISHER_READ_BUFS, MAX_READ_BUF, READ_BUF_GROUP};
+
+        // the message log wakes the loop through this when it has committed messages of durable publishers
+        EventSignal commitSignal{};
+
+        // consumers wake the loop through this when they take batches they had no room for
+        EventSignal roomSignal{};
+
+        // the loop's own queue to every subscriber loop
+        ProducerId producerId;
+
+        // stops the publishers' receives while a consumer has no room for the loop's batches
+        ReceiveThrottle receiveThrottle;
+
+        // when the publishers' lingering batches are due
+        LingerTimers lingerTimers{};
+
+        BatchPolicy batchPolicy{};
     public:
         PublisherServer(
                 int const port,
+                unsigned int const shard,
                 ServerContext* serverContext,
                 std::atomic_flag& isRunning,
                 std::function<PubSubHandler* (int, ServerContext*)>&& createFn
                 )
-            : BaseServer(port, serverContext, isRunning, std::move(createFn))
+            : BaseServer(port, serverContext, isRunning, std::move(createFn)),
+              shard(shard),
+              producerId(getMessageBus().addProducer(&roomSignal)),
+              receiveThrottle(&bufferRing, producerId)
         {}
+    public:
+        /**
+         * Sets when publishers' batches are sent. Must be set before start()
+         * @param value
+         */
+        void setBatchPolicy(BatchPolicy const& value) {
+            batchPolicy = value;
+        }
     protected:
         void printHello() override {
-            std::cout << "Publisher server started [port " << port << "]" <<std::endl;
+            std::cout << "Publisher server started [port " << port << ", shard " << shard << "]" <<std::endl;
         }
 
-        void afterConnectionAccepted(struct io_uring *ring, PubSubHandler* connection) override {
-            connection->handleEvent(ring, epfd);
+        void afterConnectionAccepted(struct io_uring *ring, PubSubHandler* pubSubHandler) override {
+            auto connection = dynamic_cast<TCPPublisherHandler*>(pubSubHandler);
+            connection->setBufferRing(&bufferRing);
+            connection->setReceiveThrottle(&receiveThrottle);
+            connection->setLingerTimers(&lingerTimers);
+            connection->setCommitSignal(&commitSignal);
+            connection->setProducerId(producerId);
+            connection->setBatchPolicy(batchPolicy);
+            connection->handleEvent(ring, 0);
         }
 
-        static void eventLoop(io_uring* ring, std::vector<io_uring_cqe*>& cqes, __kernel_timespec& ts) {
-            const int ret = io_uring_wait_cqe_timeout(ring, cqes.data(), &ts);
-            if (ret == -SIGILL || ret == TIMEOUT) {
-                return;
-            }
+        void doEventLoop(io_uring* ring) override {
+            __kernel_timespec ts{.tv_sec = 1, .tv_nsec = 0};
 
-            if (ret < 0) {
-                printError("io_uring_wait_cqe_timeout(...)", ret);
-                exit(0);
-            }
+            commitSignal.beginWait(ring);
+            roomSignal.beginWait(ring);
+            while (isRunning.test()) {
+                processCompletions(ring, ts);
+                retryAccept(ring);
 
-            std::for_each(cqes.begin(), cqes.end(), [&ring](io_uring_cqe* cqe) {
-                if (cqe != nullptr) {
-                    int res = cqe->res;
-                    if (res != -EAGAIN) {
-                        auto *pSubscriber = static_cast<BaseObject *>(io_uring_cqe_get_data(cqe));
-                        pSubscriber->handleEvent(ring, res);
+                if (roomSignal.takeIsReady()) {
+                    for (TCPPublisherHandler* publisher : receiveThrottle.onRoom()) {
+                        publisher->resumeReceive(ring);
                     }
-                    io_uring_cqe_seen(ring, cqe);
+                    roomSignal.beginWait(ring);
                 }
-            });
-        }
 
-        void doEventLoop(io_uring* ring) override {
-            constexpr static size_t NB_EVENTS = 32;
+                if (commitSignal.takeIsReady()) {
+                    sendAcks(ring);
+                    commitSignal.beginWait(ring);
+                }
 
-            std::vector<io_uring_cqe*> cqes{};
-            cqes.reserve(NB_EVENTS);
-            cqes.insert(cqes.begin(), NB_EVENTS, nullptr);
+                ts = flushLingeringBatches();
 
-            __kernel_timespec ts{.tv_sec = 1, .tv_nsec = 0};
+                // removeDisconnectedClients();
+            }
+        }
 
-            while (isRunning.test()) {
-                eventLoop(ring, cqes, ts);
+        /**
+         * Sends the batches that have lingered long enough
+         * @return How long the loop can wait before the next batch is due
+         */
+        __kernel_timespec flushLingeringBatches() {
+            auto const now{std::chrono::steady_clock::now()};
+            while (lingerTimers.isDue(now)) {
+                auto const timer{lingerTimers.pop()};
+                timer.publisher->onLingerTimer(timer.deadline, now);
+            }
 
-                // removeDisconnectedClients();
+            auto const nextDeadline{std::min(now + std::chrono::seconds{1}, lingerTimers.getNextDeadline())};
+
+            auto const delay{std::chrono::duration_cast<std::chrono::nanoseconds>(std::max(nextDeadline - now, std::chrono::steady_clock::duration::zero()))};
+            return __kernel_timespec{
+                .tv_sec = delay.count() / 1000000000,
+                .tv_nsec = delay.count() % 1000000000
+            };
+        }
+
+        /**
+         * Sends the acks of every durable publisher that has newly committed messages
+         * @param ring
+         */
+        void sendAcks(io_uring* ring) const {
+            for (PubSubHandler* client : clients) {
+                if (auto publisher = dynamic_cast<TCPPublisherHandler*>(client)) {
+                    publisher->sendAcks(ring);
+                }
             }
         }
 
         void handleEvent(struct io_uring *ring, const int res) override {
             switch (event) {
                 case Enums::Event::Event_NotSet:
+                    bufferRing.setup(ring);
                     beginSetupListenerSocket(ring);
                     break;
-                case Enums::Event::Event_SetupPublisherListeningSocket:
-                    onSetupListeningSocketComplete(ring, res);
-                    break;
                 case Enums::Event::Event_AcceptPublisherConnection:
                     onAcceptConnectionComplete(ring, res);
                     break;
@@ -0,0 +1,80 @@
+#ifndef GAZELLEMQ_SERVER_RECEIVETHROTTLE_HPP
+#define GAZELLEMQ_SERVER_RECEIVETHROTTLE_HPP
+
+#include <utility>
+#include <vector>
+
+#include "../BufferRing.hpp"
+#include "../MessageQueue.hpp"
+
+namespace gazellemq::server {
+    class TCPPublisherHandler;
+
+    /**
+     * Pushes back on a publisher loop's publishers while the message bus keeps batches that a consumer had no room
+     * for, so the loop never waits on a consumer. Receive buffers are held instead of being handed back to the kernel,
+     * so the multishot receives run out of buffers and end, and they are not re-armed until every kept batch has been
+     * queued. TCP then pushes back on the publishers.
+     */
+    class ReceiveThrottle {
+    private:
+        BufferRing* bufferRing;
+        ProducerId producerId;
+
+        // completion flags of the receive buffers held while throttled
+        std::vector<unsigned int> heldBuffers{};
+        std::vector<TCPPublisherHandler*> pausedPublishers{};
+    public:
+        ReceiveThrottle(BufferRing* bufferRing, ProducerId producerId)
+            : bufferRing(bufferRing),
+              producerId(producerId)
+        {}
+    public:
+        /**
+         * Returns true if publishers should stop receiving
+         * @return
+         */
+        [[nodiscard]] bool isThrottled() const {
+            return getMessageBus().hasPending(producerId);
+        }
+
+        /**
+         * Hands the buffer of a completion back to the kernel, or holds it while throttled
+         * @param cqeFlags
+         */
+        void release(unsigned int const cqeFlags) {
+            if (isThrottled()) {
+                heldBuffers.push_back(cqeFlags);
+            } else {
+                bufferRing->recycle(cqeFlags);
+            }
+        }
+
+        /**
+         * Remembers a publisher whose receive ended while throttled, so it can be re-armed later
+         * @param publisher
+         */
+        void pause(TCPPublisherHandler* publisher) {
+            pausedPublishers.push_back(publisher);
+        }
+
+        /**
+         * Retries the kept batches after a consumer has taken some. Once all of them are queued, the held buffers go
+         * back to the kernel and the paused publishers are returned, their receives must be re-armed.
+         * @return
+         */
+        std::vector<TCPPublisherHandler*> onRoom() {
+            if (!getMessageBus().retry(producerId)) {
+                return {};
+            }
+
+            for (unsigned int const cqeFlags : heldBuffers) {
+                bufferRing->recycle(cqeFlags);
+            }
+            heldBuffers.clear();
+            return std::exchange(pausedPublishers, {});
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_RECEIVETHROTTLE_HPP
@@ -0,0 +1,65 @@
+#ifndef GAZELLEMQ_SERVER_SHARDEDPUBLISHERSERVER_HPP
+#define GAZELLEMQ_SERVER_SHARDEDPUBLISHERSERVER_HPP
+
+#include <memory>
+
+#include "PublisherServer.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Runs several publisher loops on the same port, so receiving and parsing are spread over several cores. Each loop
+     * has its own thread, ring, receive buffers and queue to every subscriber loop, and the kernel spreads new
+     * connections between them with SO_REUSEPORT.
+     */
+    class ShardedPublisherServer {
+    private:
+        std::vector<std::unique_ptr<PublisherServer>> shards;
+    public:
+        ShardedPublisherServer(
+                int const port,
+                unsigned int const nbShards,
+                ServerContext* serverContext,
+                std::atomic_flag& isRunning,
+                std::function<PubSubHandler* (int, ServerContext*)> const& createFn
+        ) {
+            shards.reserve(nbShards);
+            for (unsigned int i{}; i < nbShards; ++i) {
+                auto& shard{shards.emplace_back(std::make_unique<PublisherServer>(
+                        port, i, serverContext, isRunning, std::function<PubSubHandler* (int, ServerContext*)>{createFn}))};
+                shard->setReusePort(nbShards > 1);
+            }
+        }
+    public:
+        /**
+         * Sets up every shard's ring. Each shard's polling thread is pinned to the CPU after the previous shard's.
+         * @param options
+         */
+        void setRingOptions(RingOptions const& options) {
+            for (size_t i{}; i < shards.size(); ++i) {
+                RingOptions shardOptions{options};
+                if (shardOptions.sqThreadCpu >= 0) {
+                    shardOptions.sqThreadCpu += static_cast<int>(i);
+                }
+                shards[i]->setRingOptions(shardOptions);
+            }
+        }
+
+        /**
+         * Sets when publishers' batches are sent
+         * @param value
+         */
+        void setBatchPolicy(BatchPolicy const& value) {
+            for (auto& shard : shards) {
+                shard->setBatchPolicy(value);
+            }
+        }
+
+        void start() {
+            for (auto& shard : shards) {
+                shard->start();
+            }
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_SHARDEDPUBLISHERSERVER_HPP
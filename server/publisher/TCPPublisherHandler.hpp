@@ -1,12 +1,21 @@
 #ifndef PUBLISHERHANDLER_HPP
 #define PUBLISHERHANDLER_HPP
 
+#include <charconv>
+#include <chrono>
 #include <condition_variable>
+#include <vector>
 
+#include "../BatchPolicy.hpp"
+#include "../BufferRing.hpp"
 #include "../MessageBatch.hpp"
 #include "../MessageQueue.hpp"
 #include "../../lib/MPMCQueue/MPMCQueue.hpp"
 #include "../PubSubHandler.hpp"
+#include "../StringUtils.hpp"
+#include "LingerTimers.hpp"
+#include "PublisherAcks.hpp"
+#include "ReceiveThrottle.hpp"
 
 namespace gazellemq::server {
     class TCPPublisherHandler final : public PubSubHandler {
@@ -17,13 +26,84 @@ namespace gazellemq::server {
             ParseState_messageContent,
         };
 
+        /**
+         * Binary framing (v2), chosen by sending '2' as the second intent char. Every frame is a one byte frame type,
+         * a varint topic id, a varint length, then that many bytes. A topic id is bound to a message type name with a
+         * declare frame before it is used in message frames.
+         */
+        enum FrameType : uint8_t {
+            FrameType_DeclareTopic = 1,
+            FrameType_Message = 2,
+        };
+
+        enum FrameState {
+            FrameState_frameType,
+            FrameState_topicId,
+            FrameState_length,
+            FrameState_body,
+        };
+
+        static constexpr size_t MAX_BINARY_TOPICS = 65536;
+        static constexpr size_t MAX_TOPIC_NAME_LENGTH = 1024;
+        static constexpr size_t MAX_FRAME_LENGTH = 16 * 1048576;
+
+        // a text message length longer than this is not a size_t
+        static constexpr size_t MAX_LENGTH_DIGITS = 20;
+
+        struct Topic {
+            MessageTypeId messageTypeId{NO_MESSAGE_TYPE};
+            std::string name;
+        };
+
         std::string writeBuffer{};
         std::string nextBatch{};
-        std::string messageType;
-        std::string messageLengthBuffer;
-        std::string messageContent;
 
+        // text messages are parsed straight into the current batch, the one being parsed starts at messageOffset and
+        // its length at lengthOffset
         MessageBatch currentBatch{};
+        size_t messageOffset{};
+        size_t lengthOffset{};
+
+        // when the complete messages of the current batch are sent, if they have not been yet
+        BatchPolicy batchPolicy{};
+        std::chrono::steady_clock::time_point lingerDeadline{std::chrono::steady_clock::time_point::max()};
+
+        /**
+         * A batch of complete messages that is kept open while the publisher sends other message types, so interleaved
+         * types still make big batches
+         */
+        struct ParkedBatch {
+            MessageBatch batch;
+            std::chrono::steady_clock::time_point lingerDeadline;
+        };
+
+        // least recently used first, with the current batch there are at most batchPolicy.maxOpenBatches open
+        std::vector<ParkedBatch> parkedBatches;
+        BufferRing* bufferRing{nullptr};
+        ReceiveThrottle* receiveThrottle{nullptr};
+
+        // the completions still expected before the socket can be closed, while the receive is being cancelled
+        unsigned int nbCancelCompletions{};
+
+        // the deadline of this publisher's latest timer in the loop's linger timers, its earlier ones are stale
+        LingerTimers* lingerTimers{nullptr};
+        std::chrono::steady_clock::time_point lingerTimerDeadline{std::chrono::steady_clock::time_point::max()};
+
+        // set when the publisher asked for durable acks, by connecting with the intent 'D'
+        std::shared_ptr<PublisherAcks> acks{};
+        EventSignal* commitSignal{nullptr};
+
+        // the publisher loop this handler's batches are published from
+        ProducerId producerId{};
+
+        // the ids of the message types this publisher has sent, so the registry is only locked for the first message
+        // of each type
+        MessageTypeIds messageTypeIds;
+
+        // the last message type seen, a key of messageTypeIds, so consecutive messages of the same type are not
+        // looked up again
+        std::string_view lastMessageType;
+        MessageTypeId lastMessageTypeId{NO_MESSAGE_TYPE};
 
         std::condition_variable cvQueue;
 
@@ -32,6 +112,17 @@ namespace gazellemq::server {
 
         unsigned int messageBatchSize;
         ParseState parseState{};
+
+        // binary framing state
+        bool isBinary{false};
+        FrameState frameState{};
+        uint8_t frameType{};
+        uint64_t varint{};
+        unsigned int varintShift{};
+        uint64_t topicId{};
+        uint64_t frameLength{};
+        std::string frameBody;
+        std::vector<Topic> topics;
         rigtorp::MPMCQueue<std::string> queue;
         bool isNew{true};
     public:
@@ -44,25 +135,102 @@ namespace gazellemq::server {
         void printHello() override {
             std::cout << clientName << " | a publisher has connected" << std::endl << std::flush;
         }
-    protected:
-        void handle(struct io_uring *ring, int res) override {
-            if (getIsDisconnected()) return;
 
-            switch (event) {
-                case Enums::Event_ReceivePublisherData:
-                    onReceiveDataComplete(ring, res);
-                    break;
-                default:
-                    break;
+        void setBufferRing(BufferRing* bufferRing) {
+            this->bufferRing = bufferRing;
+        }
+
+        void setReceiveThrottle(ReceiveThrottle* receiveThrottle) {
+            this->receiveThrottle = receiveThrottle;
+        }
+
+        void setLingerTimers(LingerTimers* lingerTimers) {
+            this->lingerTimers = lingerTimers;
+        }
+
+        void setCommitSignal(EventSignal* commitSignal) {
+            this->commitSignal = commitSignal;
+        }
+
+        void setProducerId(ProducerId value) {
+            this->producerId = value;
+        }
+
+        void setBatchPolicy(BatchPolicy const& value) {
+            this->batchPolicy = value;
+        }
+
+        /**
+         * Sends the batches that have waited for the linger time when one of this publisher's timers is due, and
+         * schedules the next one
+         * @param deadline The deadline of the timer
+         * @param now
+         */
+        void onLingerTimer(std::chrono::steady_clock::time_point deadline, std::chrono::steady_clock::time_point now) {
+            if (deadline != lingerTimerDeadline || getIsDisconnected()) {
+                return;
+            }
+
+            lingerTimerDeadline = std::chrono::steady_clock::time_point::max();
+            if (lingerDeadline <= now) {
+                flushCompleteMessages();
             }
+            scheduleLingerTimer(std::min(lingerDeadline, flushParkedBatches(now)));
+        }
+
+        /**
+         * Acknowledges the messages the message log has committed since the last call
+         * @param ring
+         */
+        void sendAcks(io_uring* ring) {
+            if (acks != nullptr && !getIsDisconnected()) {
+                acks->sendAcks(ring);
+            }
+        }
+
+        /**
+         * Re-arms the receive that ended while the loop was throttled
+         * @param ring
+         */
+        void resumeReceive(io_uring* ring) {
+            if (!getIsDisconnected()) {
+                beginReceiveData(ring);
+            }
+        }
+
+        void handleCompletion(struct io_uring *ring, io_uring_cqe const* cqe) override {
+            if (event == Enums::Event_ReceivePublisherData) {
+                onReceiveDataComplete(ring, cqe->res, cqe->flags);
+            } else if (event == Enums::Event_CancelReceive) {
+                onCancelReceiveComplete(ring, cqe->flags);
+            } else if (cqe->flags & IORING_CQE_F_BUFFER) {
+                // a receive that completed after the publisher began disconnecting, its buffer still goes back
+                receiveThrottle->release(cqe->flags);
+            } else {
+                PubSubHandler::handleCompletion(ring, cqe);
+            }
+        }
+    protected:
+        void handle(struct io_uring *ring, int res) override {
+            // received data goes through handleCompletion, it needs the buffer id from the completion flags
         }
 
         void afterSendAckComplete(struct io_uring *ring) override {
+            if (intent.starts_with('D')) {
+                acks = std::make_shared<PublisherAcks>(fd, isDirectDescriptor, commitSignal);
+            }
+            isBinary = intent.size() > 1 && intent[1] == '2';
+            reserveBatch(currentBatch);
             beginReceiveData(ring);
         }
 
         void onDisconnected (int res) override {
             std::cout << "Publisher disconnected [" << clientName << "]\n";
+            flushCompleteMessages();
+            flushParkedBatches(std::chrono::steady_clock::time_point::max());
+            if (acks != nullptr) {
+                acks->close();
+            }
             setDisconnected();
         }
     public:
@@ -75,110 +243,556 @@ namespace gazellemq::server {
         }
 
     private:
-        static void pushToQueue(MessageBatch&& batch) {
-            // std::cout << "Pushing message to queue: " << batch.getBufferRemaining() << std::endl;
-            getMessageQueue().push_back(std::move(batch));
+        void pushToQueue(MessageBatch&& batch) const {
+            // the batch was opened with room for a full one, it is charged to the queues for that room
+            batch.shrinkToFit();
+            if (acks == nullptr) {
+                getMessageBus().push_back(producerId, std::move(batch));
+            } else if (serverContext->getMessageLog() == nullptr) {
+                // nothing is logged, so there is nothing to wait for
+                unsigned int const nbMessages{batch.getNbMessages()};
+                getMessageBus().push_back(producerId, std::move(batch));
+                acks->onCommitted(nbMessages);
+            } else {
+                batch.setAcks(acks);
+                getMessageBus().push_back(producerId, std::move(batch));
+            }
+        }
+
+        /**
+         * Returns the interned id of the message type that was just parsed
+         * @param messageType
+         * @return
+         */
+        MessageTypeId getMessageTypeId(std::string_view messageType) {
+            if (lastMessageTypeId != NO_MESSAGE_TYPE && messageType == lastMessageType) {
+                return lastMessageTypeId;
+            }
+
+            auto it{messageTypeIds.find(messageType)};
+            if (it == messageTypeIds.end()) {
+                it = messageTypeIds.emplace(messageType, getMessageTypes().intern(messageType)).first;
+            }
+
+            lastMessageType = it->first;
+            lastMessageTypeId = it->second;
+            return lastMessageTypeId;
         }
 
+        /**
+         * Submits a multishot receive, which keeps completing with data until it runs out of buffers or the
+         * publisher disconnects.
+         * @param ring
+         */
         void beginReceiveData(struct io_uring* ring) {
-            memset(readBuffer, 0, MAX_READ_BUF);
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
-            io_uring_prep_recv(sqe, fd, readBuffer, MAX_READ_BUF, 0);
+            io_uring_sqe* sqe = getSqe(ring);
+            io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+            setFdFlags(sqe);
+            bufferRing->selectBuffer(sqe);
             io_uring_sqe_set_data(sqe, this);
 
             event = Enums::Event_ReceivePublisherData;
-            io_uring_submit(ring);
+        }
+
+        /**
+         * Re-arms the multishot receive after it ended, unless the loop is throttled. The receive is then re-armed
+         * once the consumers have room again.
+         * @param ring
+         */
+        void continueReceiveData(struct io_uring* ring) {
+            if (receiveThrottle->isThrottled()) {
+                receiveThrottle->pause(this);
+            } else {
+                beginReceiveData(ring);
+            }
         }
 
         /**
          * Checks if we are done receiving data
          * @param ring
          * @param res
+         * @param flags
          */
-        void onReceiveDataComplete(struct io_uring *ring, int res) {
-            if (res <= 0) {
+        void onReceiveDataComplete(struct io_uring *ring, int res, unsigned int flags) {
+            if (getIsDisconnected()) return;
+
+            if (res == -ENOBUFS) {
+                // every buffer was busy, they are back in the ring by now unless the loop is throttled
+                continueReceiveData(ring);
+            } else if (res <= 0) {
                 // The client has disconnected
                 beginDisconnect(ring);
             } else {
-                forwardMessage(readBuffer, res);
+                bool isValid{true};
+                if (isBinary) {
+                    isValid = forwardFrames(bufferRing->getBuffer(flags), res);
+                } else {
+                    isValid = forwardMessage(bufferRing->getBuffer(flags), res);
+                }
+                receiveThrottle->release(flags);
 
-                beginReceiveData(ring);
+                if (!isValid) {
+                    std::cerr << "[" << clientName << "] invalid frame, disconnecting" << std::endl;
+                    if (flags & IORING_CQE_F_MORE) {
+                        beginCancelReceive(ring);
+                    } else {
+                        beginDisconnect(ring);
+                    }
+                } else if (!(flags & IORING_CQE_F_MORE)) {
+                    continueReceiveData(ring);
+                }
+            }
+        }
+
+        /**
+         * Cancels the multishot receive, which is still armed, before the socket is closed. Otherwise it keeps taking
+         * buffers from the ring for a publisher that is gone.
+         * @param ring
+         */
+        void beginCancelReceive(struct io_uring* ring) {
+            io_uring_sqe* sqe = getSqe(ring);
+            io_uring_prep_cancel(sqe, this, 0);
+            io_uring_sqe_set_data(sqe, this);
+
+            // the cancel's completion and the receive's last one
+            nbCancelCompletions = 2;
+            event = Enums::Event_CancelReceive;
+        }
+
+        /**
+         * Gives back the buffers of the receives that completed meanwhile, and disconnects once the receive has ended
+         * @param ring
+         * @param flags
+         */
+        void onCancelReceiveComplete(struct io_uring *ring, unsigned int flags) {
+            if (flags & IORING_CQE_F_BUFFER) {
+                receiveThrottle->release(flags);
+            }
+
+            if (!(flags & IORING_CQE_F_MORE) && --nbCancelCompletions == 0) {
+                beginDisconnect(ring);
+            }
+        }
+
+        /**
+         * Reads one byte of a varint
+         * @param ch
+         * @return true once the varint is complete, it is then in [varint]
+         */
+        bool readVarint(uint8_t ch) {
+            varint |= static_cast<uint64_t>(ch & 0x7f) << varintShift;
+            varintShift += 7;
+            return (ch & 0x80) == 0;
+        }
+
+        /**
+         * Adds a message of a declared topic to the current batch, in the text framing subscribers receive
+         * @param content
+         * @param contentLength
+         */
+        void forwardFrameMessage(char const* content, size_t contentLength) {
+            Topic const& topic{topics[topicId]};
+            if (currentBatch.getMessageType() != topic.messageTypeId) {
+                switchBatch(topic.messageTypeId);
+            }
+
+            currentBatch.appendMessage(topic.name, content, contentLength);
+            messageOffset = currentBatch.getBufferLength();
+            if (isBatchDue()) {
+                flushCompleteMessages();
+            }
+        }
+
+        /**
+         * Handles a frame whose body has been read
+         * @param body
+         * @return false if the frame is invalid
+         */
+        bool onFrameComplete(char const* body) {
+            if (frameType == FrameType_DeclareTopic) {
+                if (topicId >= MAX_BINARY_TOPICS || frameLength == 0 || frameLength > MAX_TOPIC_NAME_LENGTH) {
+                    return false;
+                }
+
+                // subscribers could not parse type|length|content if the type had a '|' in it
+                if (memchr(body, '|', frameLength) != nullptr) {
+                    return false;
+                }
+
+                if (topicId >= topics.size()) {
+                    topics.resize(topicId + 1);
+                }
+                topics[topicId].name.assign(body, frameLength);
+                topics[topicId].messageTypeId = getMessageTypes().intern(topics[topicId].name);
+            } else {
+                if (topicId >= topics.size() || topics[topicId].messageTypeId == NO_MESSAGE_TYPE) {
+                    return false;
+                }
+                forwardFrameMessage(body, frameLength);
             }
+
+            frameState = FrameState_frameType;
+            return true;
         }
 
         /**
-         * forwards the message to subscribers
+         * Forwards the messages of binary frames to subscribers. Headers are a few byte loads, and a body that is all in
+         * the buffer is copied straight into the batch.
          * @param buffer
          * @param bufferLength
+         * @return false if the publisher sent something that is not a valid frame
          */
-        void forwardMessage(char const* buffer, size_t bufferLength) {
-            for (size_t i{0}; i < bufferLength; ++i) {
-                char ch {buffer[i]};
-                if (parseState == ParseState_messageType) {
-                    if (ch == '|') {
-                        parseState = ParseState_messageContentLength;
-                        continue;
-                    } else {
-                        messageType.push_back(ch);
+        bool forwardFrames(char const* buffer, size_t bufferLength) {
+            size_t i{};
+            while (i < bufferLength) {
+                switch (frameState) {
+                    case FrameState_frameType:
+                        frameType = static_cast<uint8_t>(buffer[i++]);
+                        if (frameType != FrameType_DeclareTopic && frameType != FrameType_Message) {
+                            return false;
+                        }
+                        varint = 0;
+                        varintShift = 0;
+                        frameState = FrameState_topicId;
+                        break;
+                    case FrameState_topicId:
+                    case FrameState_length:
+                        if (varintShift > 56) {
+                            return false;
+                        }
+
+                        if (readVarint(static_cast<uint8_t>(buffer[i++]))) {
+                            if (frameState == FrameState_topicId) {
+                                topicId = varint;
+                                frameState = FrameState_length;
+                            } else {
+                                frameLength = varint;
+                                if (frameLength > MAX_FRAME_LENGTH) {
+                                    return false;
+                                }
+
+                                if (frameType == FrameType_Message && topicId < topics.size() && isMessageTooBig(topics[topicId].name.size(), frameLength)) {
+                                    return false;
+                                }
+
+                                frameBody.clear();
+                                frameState = FrameState_body;
+                                if (frameLength == 0 && !onFrameComplete("")) {
+                                    return false;
+                                }
+                            }
+                            varint = 0;
+                            varintShift = 0;
+                        }
+                        break;
+                    case FrameState_body: {
+                        size_t const nbAvailable{bufferLength - i};
+                        if (frameBody.empty() && nbAvailable >= frameLength) {
+                            // the whole body is here, no need to copy it twice
+                            if (!onFrameComplete(&buffer[i])) {
+                                return false;
+                            }
+                            i += frameLength;
+                        } else {
+                            size_t const nbNeeded{std::min<size_t>(frameLength - frameBody.size(), nbAvailable)};
+                            frameBody.append(&buffer[i], nbNeeded);
+                            i += nbNeeded;
+                            if (frameBody.size() == frameLength && !onFrameComplete(frameBody.data())) {
+                                return false;
+                            }
+                        }
+                        break;
                     }
-                } else if (parseState == ParseState_messageContentLength) {
-                    if (ch == '|') {
-                        messageContentLength = std::stoul(messageLengthBuffer);
-                        parseState = ParseState_messageContent;
-                        continue;
-                    } else {
-                        messageLengthBuffer.push_back(ch);
+                }
+            }
+
+            onReceiveParsed();
+            return true;
+        }
+
+        /**
+         * Returns true if a message is bigger, in the text framing subscribers receive, than the batch policy allows.
+         * The message log needs every batch to fit in a segment, so such a message is not skipped but refused.
+         * @param typeLength
+         * @param contentLength
+         * @return
+         */
+        [[nodiscard]] bool isMessageTooBig(size_t typeLength, size_t contentLength) const {
+            char digits[24];
+            size_t const nbDigits{static_cast<size_t>(std::to_chars(digits, digits + sizeof(digits), contentLength).ptr - digits)};
+            size_t const messageLength{typeLength + 1 + nbDigits + 1 + contentLength};
+            if (messageLength <= batchPolicy.maxMessageBytes) {
+                return false;
+            }
+
+            std::cerr << "[" << clientName << "] message of " << messageLength << " bytes is bigger than the " << batchPolicy.maxMessageBytes << " allowed" << std::endl;
+            return true;
+        }
+
+        /**
+         * Gives a batch that was just opened room for the batch size limit and one more message of up to that size, so
+         * it is not grown, and copied again, as messages are added
+         * @param batch
+         */
+        void reserveBatch(MessageBatch& batch) const {
+            batch.reserve(batchPolicy.maxBytes * 2);
+        }
+
+        /**
+         * Returns true if the current batch has reached one of the sizes of the batch policy
+         * @return
+         */
+        [[nodiscard]] bool isBatchDue() const {
+            return currentBatch.getBufferLength() >= batchPolicy.maxBytes || currentBatch.getNbMessages() >= batchPolicy.maxMessages;
+        }
+
+        /**
+         * Sends the complete messages at the end of a receive, or starts their linger time
+         */
+        void onReceiveParsed() {
+            if (currentBatch.getNbMessages() == 0 && parkedBatches.empty()) {
+                return;
+            }
+
+            if (batchPolicy.lingerUs == 0) {
+                flushCompleteMessages();
+                flushParkedBatches(std::chrono::steady_clock::time_point::max());
+            } else {
+                if (currentBatch.getNbMessages() > 0 && lingerDeadline == std::chrono::steady_clock::time_point::max()) {
+                    lingerDeadline = std::chrono::steady_clock::now() + std::chrono::microseconds{batchPolicy.lingerUs};
+                }
+
+                auto nextDeadline{lingerDeadline};
+                for (ParkedBatch const& parked : parkedBatches) {
+                    nextDeadline = std::min(nextDeadline, parked.lingerDeadline);
+                }
+                scheduleLingerTimer(nextDeadline);
+            }
+        }
+
+        /**
+         * Adds a timer for the deadline to the loop's linger timers, unless an earlier one is already there
+         * @param deadline
+         */
+        void scheduleLingerTimer(std::chrono::steady_clock::time_point deadline) {
+            if (deadline < lingerTimerDeadline) {
+                lingerTimerDeadline = deadline;
+                lingerTimers->schedule(this, deadline);
+            }
+        }
+
+        /**
+         * Sends the messages of the current batch that are complete. The message still being parsed is moved to the
+         * start of a new batch.
+         */
+        void flushCompleteMessages() {
+            lingerDeadline = std::chrono::steady_clock::time_point::max();
+            if (currentBatch.getNbMessages() == 0) {
+                return;
+            }
+
+            if (messageOffset == currentBatch.getBufferLength()) {
+                pushToQueue(std::move(currentBatch));
+                currentBatch.clearForNextMessage();
+                reserveBatch(currentBatch);
+            } else {
+                MessageBatch next{};
+                reserveBatch(next);
+                next.appendRaw(&currentBatch.getBuffer()[messageOffset], currentBatch.getBufferLength() - messageOffset);
+                if (parseState != ParseState_messageType) {
+                    // the partial message's type was already matched to the batch
+                    next.setMessageType(currentBatch.getMessageType());
+                    lengthOffset -= messageOffset;
+                }
+
+                currentBatch.truncate(messageOffset);
+                pushToQueue(std::move(currentBatch));
+                currentBatch = std::move(next);
+            }
+            messageOffset = 0;
+        }
+
+        /**
+         * Sends the parked batches that have waited for the linger time
+         * @param now
+         * @return When the next parked batch is due, or time_point::max() if none is parked
+         */
+        std::chrono::steady_clock::time_point flushParkedBatches(std::chrono::steady_clock::time_point now) {
+            auto nextDeadline{std::chrono::steady_clock::time_point::max()};
+            std::erase_if(parkedBatches, [&](ParkedBatch& parked) {
+                if (parked.lingerDeadline <= now) {
+                    pushToQueue(std::move(parked.batch));
+                    return true;
+                }
+
+                nextDeadline = std::min(nextDeadline, parked.lingerDeadline);
+                return false;
+            });
+            return nextDeadline;
+        }
+
+        /**
+         * Makes the open batch of the message type the current batch, opening one if there is none. The partial
+         * message at the end of the current batch moves with it, and the complete messages are parked, or sent when
+         * only one batch can be open. The least recently used parked batch is sent when there are too many.
+         * @param messageTypeId
+         */
+        void switchBatch(MessageTypeId messageTypeId) {
+            auto const parked{std::ranges::find_if(parkedBatches, [&](ParkedBatch const& p) {
+                return p.batch.getMessageType() == messageTypeId;
+            })};
+
+            if (currentBatch.getNbMessages() == 0 && parked == parkedBatches.end()) {
+                currentBatch.setMessageType(messageTypeId);
+                return;
+            }
+
+            MessageBatch next{};
+            auto nextDeadline{std::chrono::steady_clock::time_point::max()};
+            if (parked != parkedBatches.end()) {
+                next = std::move(parked->batch);
+                nextDeadline = parked->lingerDeadline;
+                parkedBatches.erase(parked);
+            } else {
+                reserveBatch(next);
+                next.setMessageType(messageTypeId);
+            }
+
+            size_t const nextMessageOffset{next.getBufferLength()};
+            if (currentBatch.getBufferLength() > messageOffset) {
+                next.appendRaw(&currentBatch.getBuffer()[messageOffset], currentBatch.getBufferLength() - messageOffset);
+            }
+            currentBatch.truncate(messageOffset);
+
+            if (currentBatch.getNbMessages() > 0) {
+                if (getMaxOpenBatches() <= 1) {
+                    pushToQueue(std::move(currentBatch));
+                } else {
+                    if (parkedBatches.size() + 1 >= getMaxOpenBatches()) {
+                        pushToQueue(std::move(parkedBatches.front().batch));
+                        parkedBatches.erase(parkedBatches.begin());
                     }
-                } else if (parseState == ParseState_messageContent) {
-                    size_t nbCharsNeeded {messageContentLength - nbContentBytesRead};
-                    // add as many characters as possible in bulk
 
-                    if ((i + nbCharsNeeded) <= bufferLength) {
-                        messageContent.append(&buffer[i], nbCharsNeeded);
-                        // do nothing here for now
-                    } else {
-                        nbCharsNeeded = bufferLength - i;
-                        messageContent.append(&buffer[i], nbCharsNeeded);
+                    if (lingerDeadline == std::chrono::steady_clock::time_point::max()) {
+                        lingerDeadline = std::chrono::steady_clock::now() + std::chrono::microseconds{batchPolicy.lingerUs};
                     }
+                    parkedBatches.push_back(ParkedBatch{std::move(currentBatch), lingerDeadline});
+                }
+            }
 
-                    nbContentBytesRead += nbCharsNeeded;
-                    i += nbCharsNeeded - 1;
-
-                    if (messageContentLength == nbContentBytesRead) {
-                        // Done parsing
-                        std::string message{};
-                        message.append(messageType);
-                        message.push_back('|');
-                        message.append(messageLengthBuffer);
-                        message.push_back('|');
-                        message.append(messageContent);
-
-                        if (currentBatch.getMessageType().empty()) {
-                            currentBatch.setMessageType(messageType);
-                        } else if ((currentBatch.getMessageType() != messageType) || (currentBatch.isFull())) {
-                            pushToQueue(std::move(currentBatch));
-                            currentBatch.clearForNextMessage();
-                            currentBatch.setMessageType(messageType);
-                        }
+            currentBatch = std::move(next);
+            messageOffset = nextMessageOffset;
+            lingerDeadline = nextDeadline;
+        }
 
-                        currentBatch.append(std::move(message));
+        /**
+         * Returns how many batches can be open at once. Durable publishers have one, their acks count messages in the
+         * order they were sent, so batches must be committed in that order too.
+         * @return
+         */
+        [[nodiscard]] size_t getMaxOpenBatches() const {
+            return acks != nullptr ? 1 : batchPolicy.maxOpenBatches;
+        }
 
-                        if (i == (bufferLength-1)) {
-                            pushToQueue(std::move(currentBatch));
-                            currentBatch.clearForNextMessage();
+        /**
+         * Picks the batch for the message whose type was just parsed, the type and its '|' are at the end of the
+         * current batch
+         */
+        void onMessageTypeParsed() {
+            std::string_view const messageType{&currentBatch.getBuffer()[messageOffset], currentBatch.getBufferLength() - messageOffset - 1};
+            MessageTypeId const messageTypeId{getMessageTypeId(messageType)};
+            if (currentBatch.getMessageType() != messageTypeId) {
+                switchBatch(messageTypeId);
+            }
+
+            lengthOffset = currentBatch.getBufferLength();
+            parseState = ParseState_messageContentLength;
+        }
+
+        /**
+         * Parses the length that was just written to the current batch
+         * @return false if it is not a number
+         */
+        bool onMessageLengthParsed() {
+            char const* lengthStart{&currentBatch.getBuffer()[lengthOffset]};
+            char const* lengthEnd{&currentBatch.getBuffer()[currentBatch.getBufferLength() - 1]};
+            auto const [ptr, ec]{std::from_chars(lengthStart, lengthEnd, messageContentLength)};
+            if (ec != std::errc{} || ptr != lengthEnd) {
+                return false;
+            }
+
+            if (isMessageTooBig(lengthOffset - messageOffset - 1, messageContentLength)) {
+                return false;
+            }
+
+            parseState = ParseState_messageContent;
+            return true;
+        }
+
+        /**
+         * Counts the message that was just parsed in the current batch, and sends the batch if it is big enough
+         */
+        void onMessageParsed() {
+            currentBatch.endMessage(messageOffset);
+            messageOffset = currentBatch.getBufferLength();
+            messageContentLength = 0;
+            nbContentBytesRead = 0;
+            parseState = ParseState_messageType;
+
+            if (isBatchDue()) {
+                flushCompleteMessages();
+            }
+        }
+
+        /**
+         * forwards the message to subscribers. Messages are written to the current batch as they are parsed, so
+         * every byte is copied once, and a message split across receives carries on where the last one stopped. The
+         * message type and the length run up to the next '|', which is found with a vectorized scan.
+         * @param buffer
+         * @param bufferLength
+         * @return false if a message length is not a number
+         */
+        bool forwardMessage(char const* buffer, size_t bufferLength) {
+            size_t i{0};
+            while (i < bufferLength) {
+                if (parseState == ParseState_messageContent) {
+                    // add as many characters as possible in bulk
+                    size_t const nbCharsNeeded{std::min(messageContentLength - nbContentBytesRead, bufferLength - i)};
+                    currentBatch.appendRaw(&buffer[i], nbCharsNeeded);
+                    nbContentBytesRead += nbCharsNeeded;
+                    i += nbCharsNeeded;
+                } else {
+                    size_t const nbChars{gazellemq::utils::findChar(&buffer[i], bufferLength - i, '|')};
+                    if (i + nbChars == bufferLength) {
+                        // the rest of the field comes with the next buffer
+                        currentBatch.appendRaw(&buffer[i], nbChars);
+                        if (parseState == ParseState_messageContentLength && currentBatch.getBufferLength() - lengthOffset > MAX_LENGTH_DIGITS) {
+                            return false;
                         }
+                        break;
+                    }
 
+                    // the field and its '|'
+                    currentBatch.appendRaw(&buffer[i], nbChars + 1);
+                    i += nbChars + 1;
+                    if (parseState == ParseState_messageType) {
+                        onMessageTypeParsed();
+                        continue;
+                    }
 
-                        // fnPushToQueue(messageType, std::move(message));
-                        messageContentLength = 0;
-                        nbContentBytesRead = 0;
-                        messageLengthBuffer.clear();
-                        messageType.clear();
-                        messageContent.clear();
-                        parseState = ParseState_messageType;
+                    if (!onMessageLengthParsed()) {
+                        return false;
                     }
                 }
+
+                if (messageContentLength == nbContentBytesRead) {
+                    // Done parsing
+                    onMessageParsed();
+                }
             }
+
+            onReceiveParsed();
+            return true;
         }
     };
 }
@@ -0,0 +1,88 @@
+#ifndef GAZELLEMQ_SERVER_RETAINEDMESSAGES_HPP
+#define GAZELLEMQ_SERVER_RETAINEDMESSAGES_HPP
+
+#include <functional>
+#include <vector>
+
+#include "../MessageBatch.hpp"
+
+namespace gazellemq::server {
+    /**
+     * The last message published for each message type, sent to subscribers as soon as they subscribe. Owned by one
+     * subscriber loop, which sees every published batch anyway.
+     *
+     * Updating only keeps the batch the message came in and where the message starts, so batches of types nobody
+     * subscribes to cost no allocation. The message is copied into a batch of its own the first time a subscriber
+     * needs it, which also lets go of the batch it came in. Messages bigger than LAST_MSG_BUF_SIZE are not kept.
+     */
+    class RetainedMessages {
+    private:
+        struct RetainedMessage {
+            SharedMessageBatch batch;
+
+            // where the message starts in the batch, it runs to the end of it
+            size_t offset;
+
+            // set once the batch holds only the message
+            bool isCopied;
+        };
+
+        // indexed by message type id
+        std::vector<RetainedMessage> messages;
+    public:
+        /**
+         * Remembers the last message of the batch
+         * @param batch
+         */
+        void update(SharedMessageBatch const& batch) {
+            MessageTypeId const messageType{batch->getMessageType()};
+            if (messageType == NO_MESSAGE_TYPE) {
+                return;
+            }
+
+            if (messageType >= messages.size()) {
+                messages.resize(messageType + 1);
+            }
+
+            if (batch->getBufferLength() - batch->getLastMessageOffset() > LAST_MSG_BUF_SIZE) {
+                // an older message would be stale, so nothing is kept
+                messages[messageType] = RetainedMessage{};
+                return;
+            }
+
+            messages[messageType] = RetainedMessage{batch, batch->getLastMessageOffset(), false};
+        }
+
+        /**
+         * Calls fn with the id of every message type that has a retained message
+         * @param fn
+         */
+        void forEachMessageType(std::function<void(MessageTypeId)> const& fn) const {
+            for (MessageTypeId messageType{}; messageType < messages.size(); ++messageType) {
+                if (messages[messageType].batch != nullptr) {
+                    fn(messageType);
+                }
+            }
+        }
+
+        /**
+         * Returns a batch holding only the retained message of the message type, copying it out of the batch it came
+         * in the first time
+         * @param messageType
+         * @return
+         */
+        [[nodiscard]] SharedMessageBatch get(MessageTypeId messageType) {
+            RetainedMessage& retained{messages[messageType]};
+            if (!retained.isCopied) {
+                MessageBatch message{};
+                message.setMessageType(messageType);
+                message.appendRaw(&retained.batch->getBuffer()[retained.offset], retained.batch->getBufferLength() - retained.offset);
+                message.endMessage(0);
+                retained = RetainedMessage{std::make_shared<MessageBatch const>(std::move(message)), 0, true};
+            }
+            return retained.batch;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_RETAINEDMESSAGES_HPP
@@ -0,0 +1,86 @@
+#ifndef GAZELLEMQ_SERVER_SHARDEDSUBSCRIBERSERVER_HPP
+#define GAZELLEMQ_SERVER_SHARDEDSUBSCRIBERSERVER_HPP
+
+#include <memory>
+
+#include "SubscriberServer.hpp"
+
+namespace gazellemq::server {
+    /**
+     * Runs several subscriber loops on the same port. Each loop has its own thread, ring, clients and message queue,
+     * and the kernel spreads new connections between them with SO_REUSEPORT.
+     */
+    class ShardedSubscriberServer {
+    private:
+        std::vector<std::unique_ptr<SubscriberServer>> shards;
+    public:
+        ShardedSubscriberServer(
+                int const port,
+                unsigned int const nbShards,
+                ServerContext* serverContext,
+                std::atomic_flag& isRunning,
+                std::function<PubSubHandler* (int, ServerContext*)> const& createFn
+        ) {
+            shards.reserve(nbShards);
+            for (unsigned int i{}; i < nbShards; ++i) {
+                auto& shard{shards.emplace_back(std::make_unique<SubscriberServer>(
+                        port, i, serverContext, isRunning, std::function<PubSubHandler* (int, ServerContext*)>{createFn}))};
+                shard->setReusePort(nbShards > 1);
+            }
+        }
+    public:
+        /**
+         * Sets up every shard's ring. Each shard's polling thread is pinned to the CPU after the previous shard's.
+         * @param options
+         */
+        void setRingOptions(RingOptions const& options) {
+            for (size_t i{}; i < shards.size(); ++i) {
+                RingOptions shardOptions{options};
+                if (shardOptions.sqThreadCpu >= 0) {
+                    shardOptions.sqThreadCpu += static_cast<int>(i);
+                }
+                shards[i]->setRingOptions(shardOptions);
+            }
+        }
+
+        /**
+         * Sends of at least this many bytes use zero copy, 0 turns zero copy sends off
+         * @param value
+         */
+        void setZeroCopyThreshold(size_t value) {
+            for (auto& shard : shards) {
+                shard->setZeroCopyThreshold(value);
+            }
+        }
+
+        /**
+         * Sets how many batches each subscriber can have waiting to be sent
+         * @param value
+         */
+        void setSubscriberQueueDepth(size_t value) {
+            for (auto& shard : shards) {
+                shard->setSubscriberQueueDepth(value);
+            }
+        }
+
+        void start() {
+            for (auto& shard : shards) {
+                shard->start();
+            }
+        }
+
+        /**
+         * Returns the clients of every shard. Safe to call from any thread, such as the command server's.
+         * @return
+         */
+        std::vector<PubSubHandler*> getClients() {
+            std::vector<PubSubHandler*> retVal;
+            for (auto& shard : shards) {
+                std::ranges::copy(shard->getClients(), std::back_inserter(retVal));
+            }
+            return retVal;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_SHARDEDSUBSCRIBERSERVER_HPP
@@ -2,146 +2,170 @@
 #define SUBSCRIBERSERVER_HPP
 #include "../BaseServer.hpp"
 #include "../MessageQueue.hpp"
+#include "RetainedMessages.hpp"
 #include "TCPSubscriberHandler.hpp"
 
 namespace gazellemq::server {
     class SubscriberServer final : public BaseServer {
     private:
+        unsigned int shard;
+        SubscriptionIndex subscriptionIndex{};
+        RetainedMessages retainedMessages{};
+        MessageQueue messageQueue{getMessageQueueOptions()};
+
+        // the command server wakes the loop through this when it posts subscriptions or replays
+        EventSignal postSignal{};
+        size_t zeroCopyThreshold{};
+        size_t subscriberQueueDepth{DEFAULT_SUBSCRIBER_QUEUE_DEPTH};
+
+        // a batch that a blocking subscriber has no room for, nothing else is fanned out until it is delivered
+        SharedMessageBatch heldBatch{};
     public:
         SubscriberServer(
                 int const port,
+                unsigned int const shard,
                 ServerContext* serverContext,
                 std::atomic_flag& isRunning,
                 std::function<PubSubHandler* (int, ServerContext*)>&& createFn
                 )
-            : BaseServer(port, serverContext, isRunning, std::move(createFn))
-        {}
+            : BaseServer(port, serverContext, isRunning, std::move(createFn)),
+              shard(shard)
+        {
+            // every subscriber loop receives every published batch
+            getMessageBus().addQueue(&messageQueue);
+        }
+
+        /**
+         * Sends of at least this many bytes use zero copy, 0 turns zero copy sends off. Must be set before start()
+         * @param value
+         */
+        void setZeroCopyThreshold(size_t value) {
+            zeroCopyThreshold = value;
+        }
+
+        /**
+         * Sets how many batches each subscriber can have waiting to be sent. Must be set before start()
+         * @param value
+         */
+        void setSubscriberQueueDepth(size_t value) {
+            subscriberQueueDepth = value;
+        }
     protected:
-        void handleTimeouts() const {
+        void handleTimeouts(io_uring* ring) const {
             for (auto& client : clients) {
-                dynamic_cast<TCPSubscriberHandler*>(client)->handleTimeout();
+                auto subscriber = dynamic_cast<TCPSubscriberHandler*>(client);
+                if (subscriber->getIsDisconnected()) continue;
+
+                subscriber->applyPostedSubscriptions(ring);
+                subscriber->handleTimeout();
             }
         }
 
         void printHello() override {
-            std::cout << "Subscriber server started [port " << port << "]" <<std::endl;
+            std::cout << "Subscriber server started [port " << port << ", shard " << shard << "]" <<std::endl;
         }
 
         void afterConnectionAccepted(struct io_uring *ring, PubSubHandler* pubSubHandler) override {
             auto connection = dynamic_cast<TCPSubscriberHandler*>(pubSubHandler);
             connection->setServerContext(serverContext);
-            connection->handleEvent(ring, epfd);
+            connection->setSubscriptionIndex(&subscriptionIndex);
+            connection->setRetainedMessages(&retainedMessages);
+            connection->setPostSignal(&postSignal);
+            connection->setZeroCopyThreshold(zeroCopyThreshold);
+            connection->setQueueDepth(subscriberQueueDepth);
+            connection->handleEvent(ring, 0);
         }
 
-        bool drainQueue(io_uring* ring, MessageQueue& q) {
-            MessageBatch batch;
-            bool retVal {false};
-            while (q.try_pop(batch)) {
-                std::ranges::for_each(clients, [&](PubSubHandler* pubSubHandler) {
-                    auto subscriber = dynamic_cast<TCPSubscriberHandler*>(pubSubHandler);
-                    if (subscriber->getIsDisconnected()) return;
-
-                    if (subscriber->isSubscribed(batch.getMessageType())) {
-                        subscriber->pushMessageBatch(ring, batch);
-                    }
-                });
+        /**
+         * Turns zero copy sends off when the kernel does not support them
+         * @param ring
+         */
+        void probeZeroCopy(io_uring* ring) {
+            if (zeroCopyThreshold == 0) {
+                return;
             }
 
-            q.afQueue.clear();
-            {
-                std::lock_guard lockGuard{q.mQueue};
-                if (q.hasPendingData.test()) {
-                    q.hasPendingData.clear();
-                    q.cvQueue.notify_all();
-                }
+            io_uring_probe* probe{io_uring_get_probe_ring(ring)};
+            if (probe == nullptr || !io_uring_opcode_supported(probe, IORING_OP_SEND_ZC)) {
+                std::cout << "Zero copy sends are not supported by this kernel" << std::endl;
+                zeroCopyThreshold = 0;
             }
 
-            return retVal;
+            if (probe != nullptr) {
+                io_uring_free_probe(probe);
+            }
         }
 
-        static void eventLoop(io_uring* ring, std::vector<io_uring_cqe *>& cqes, __kernel_timespec& ts) {
-            int ret = io_uring_wait_cqe_timeout(ring, cqes.data(), &ts);
-            if (ret == -SIGILL || ret == TIMEOUT) {
-                return;
-            }
+        /**
+         * Fans the queued batches out to the subscribers. Stops early if a subscriber that asked to block has no room,
+         * which leaves the batches in the queue and eventually makes the publishers wait.
+         * @param ring
+         * @param q
+         * @return true if the queue was drained
+         */
+        bool drainQueue(io_uring* ring, MessageQueue& q) {
+            SharedMessageBatch batch{std::move(heldBatch)};
+            while (batch != nullptr || q.try_pop(batch)) {
+                auto const& subscribers{subscriptionIndex.getSubscribers(batch->getMessageType())};
+                if (std::ranges::any_of(subscribers, [&](TCPSubscriberHandler const* subscriber) {
+                    return !subscriber->getIsDisconnected() && subscriber->isBlocking(batch->getMessageType());
+                })) {
+                    heldBatch = std::move(batch);
+                    return false;
+                }
 
-            if (ret < 0) {
-                printError("io_uring_wait_cqe_timeout(...)", ret);
-                return;
-            }
+                retainedMessages.update(batch);
 
-            for (auto* cqe: cqes) {
-                if (cqe != nullptr) {
-                    int res = cqe->res;
-                    if (res == -EAGAIN) {
-                        io_uring_cqe_seen(ring, cqe);
-                        continue;
+                // stored once, every matching subscriber sends from the same bytes
+                for (TCPSubscriberHandler* subscriber : subscribers) {
+                    if (!subscriber->getIsDisconnected()) {
+                        subscriber->pushMessageBatch(ring, batch);
                     }
-
-                    auto* pObject = static_cast<BaseObject*>(io_uring_cqe_get_data(cqe));
-                    pObject->handleEvent(ring, res);
                 }
-                io_uring_cqe_seen(ring, cqe);
+                batch.reset();
             }
-
-            // removeDisconnectedClients();
+            return true;
         }
 
         /**
-         * Does the event loop
+         * Does the event loop. Connections, send completions and publisher wakeups all arrive on the ring.
          */
         void doEventLoop(io_uring* ring) override {
-            using namespace std::chrono_literals;
-
-            std::vector<io_uring_cqe *> cqes{};
-            cqes.reserve(maxEventBatch);
-            cqes.insert(cqes.begin(), maxEventBatch, nullptr);
-
             __kernel_timespec ts{.tv_sec = 1, .tv_nsec = 0};
-            auto& q = getMessageQueue();
 
+            bool hasBatches{false};
+            messageQueue.beginWait(ring);
+            postSignal.beginWait(ring);
             while (isRunning.test()) {
-                while (isRunning.test()) {
-                    // for the most part, this loop will handle new connections
-                    eventLoop(ring, cqes, ts);
+                processCompletions(ring, ts);
+                retryAccept(ring);
 
-                    // check if any clients have timed out
-                    handleTimeouts();
-
-                    // if is nothing left to do then break
-                    if (allIdle()) {
-                        break;
-                    }
+                // what was posted is applied by handleTimeouts() below
+                if (postSignal.takeIsReady()) {
+                    postSignal.beginWait(ring);
                 }
 
-                while (isRunning.test()) {
-                    // for most part, this loop will handle the sending of messages
-                    std::unique_lock uniqueLock{q.mQueue};
-                    const bool didTimeout{!q.cvQueue.wait_for(uniqueLock, 1s, [&]() { return q.hasPendingData.test(); })};
-
-                    uniqueLock.unlock();
-
-                    if (didTimeout || !drainQueue(ring, q)) {
-                        break;
-                    }
-
-                    eventLoop(ring, cqes, ts);
+                if (messageQueue.takeIsReady()) {
+                    hasBatches = true;
+                    messageQueue.beginWait(ring);
+                }
 
-                    if (allIdle()) {
-                        break;
-                    }
+                // keeps trying after a blocking subscriber held things up, its send completions wake the loop
+                if (hasBatches) {
+                    hasBatches = !drainQueue(ring, messageQueue);
                 }
+
+                // check if any clients have timed out, and pick up subscriptions from the command server
+                handleTimeouts(ring);
             }
         }
 
         void handleEvent(struct io_uring *ring, const int res) override {
             switch (event) {
                 case Enums::Event::Event_NotSet:
+                    probeZeroCopy(ring);
                     beginSetupListenerSocket(ring);
                     break;
-                case Enums::Event::Event_SetupPublisherListeningSocket:
-                    onSetupListeningSocketComplete(ring, res);
-                    break;
                 case Enums::Event::Event_AcceptPublisherConnection:
                     onAcceptConnectionComplete(ring, res);
                     break;
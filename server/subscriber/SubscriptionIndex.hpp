@@ -0,0 +1,131 @@
+#ifndef GAZELLEMQ_SERVER_SUBSCRIPTIONINDEX_HPP
+#define GAZELLEMQ_SERVER_SUBSCRIPTIONINDEX_HPP
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../MessageTypes.hpp"
+
+namespace gazellemq::server {
+    class TCPSubscriberHandler;
+
+    /**
+     * Routes a message type to the subscribers that want it. A subscriber wants a message type when any of its
+     * subscriptions starts with that message type, so subscriptions are kept in a prefix trie where every node knows
+     * which subscribers have a subscription below it.
+     */
+    class SubscriptionIndex {
+    private:
+        struct Node {
+            std::unordered_map<char, std::unique_ptr<Node>> children;
+
+            // number of subscriptions at or below this node, per subscriber
+            std::unordered_map<TCPSubscriberHandler*, unsigned int> subscribers;
+        };
+
+        struct Match {
+            unsigned long generation{};
+            std::vector<TCPSubscriberHandler*> subscribers;
+        };
+
+        Node root{};
+
+        // cached lookups indexed by message type id, only valid while their generation is current
+        std::vector<Match> matches;
+        unsigned long generation{1};
+    public:
+        /**
+         * Indexes a subscription
+         * @param subscriber
+         * @param subscription
+         */
+        void add(TCPSubscriberHandler* subscriber, std::string const& subscription) {
+            Node* node{&root};
+            ++node->subscribers[subscriber];
+            for (char const ch : subscription) {
+                std::unique_ptr<Node>& child{node->children[ch]};
+                if (child == nullptr) {
+                    child = std::make_unique<Node>();
+                }
+
+                node = child.get();
+                ++node->subscribers[subscriber];
+            }
+
+            ++generation;
+        }
+
+        /**
+         * Removes a subscription that was previously indexed
+         * @param subscriber
+         * @param subscription
+         */
+        void remove(TCPSubscriberHandler* subscriber, std::string const& subscription) {
+            std::vector<Node*> path;
+            path.reserve(subscription.size() + 1);
+            path.push_back(&root);
+            for (char const ch : subscription) {
+                auto it{path.back()->children.find(ch)};
+                if (it == path.back()->children.end()) {
+                    return;
+                }
+                path.push_back(it->second.get());
+            }
+
+            for (Node* node : path) {
+                auto it{node->subscribers.find(subscriber)};
+                if (it != node->subscribers.end() && --it->second == 0) {
+                    node->subscribers.erase(it);
+                }
+            }
+
+            // prune the nodes nobody subscribes through anymore
+            for (size_t i{path.size() - 1}; i > 0; --i) {
+                if (!path[i]->subscribers.empty()) {
+                    break;
+                }
+                path[i - 1]->children.erase(subscription[i - 1]);
+            }
+
+            ++generation;
+        }
+
+        /**
+         * Returns the subscribers that are subscribed to the passed in message type
+         * @param messageType
+         * @return
+         */
+        std::vector<TCPSubscriberHandler*> const& getSubscribers(MessageTypeId messageType) {
+            if (messageType >= matches.size()) {
+                matches.resize(messageType + 1);
+            }
+
+            Match& match{matches[messageType]};
+            if (match.generation == generation) {
+                return match.subscribers;
+            }
+
+            match.generation = generation;
+            match.subscribers.clear();
+
+            Node const* node{&root};
+            for (char const ch : getMessageTypes().getName(messageType)) {
+                auto child{node->children.find(ch)};
+                if (child == node->children.end()) {
+                    return match.subscribers;
+                }
+                node = child->second.get();
+            }
+
+            for (auto const& [subscriber, count] : node->subscribers) {
+                match.subscribers.push_back(subscriber);
+            }
+
+            return match.subscribers;
+        }
+    };
+}
+
+#endif //GAZELLEMQ_SERVER_SUBSCRIPTIONINDEX_HPP
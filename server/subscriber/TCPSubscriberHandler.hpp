@@ -1,11 +1,19 @@
 #ifndef SUBSCRIBERHANDLER_HPP
 #define SUBSCRIBERHANDLER_HPP
-#include <list>
+#include <climits>
+#include <deque>
+#include <mutex>
 #include <vector>
+#include <sys/socket.h>
 
-#include "../MessageBatch.hpp"
+#include "../BoundedQueue.hpp"
+#include "../EventSignal.hpp"
+#include "../MessageBatchCursor.hpp"
 #include "../PubSubHandler.hpp"
+#include "../log/MessageLog.hpp"
 #include "../StringUtils.hpp"
+#include "RetainedMessages.hpp"
+#include "SubscriptionIndex.hpp"
 
 namespace gazellemq::server {
     class TCPSubscriberHandler : public PubSubHandler {
@@ -14,12 +22,49 @@ namespace gazellemq::server {
             unsigned long timeout{};
             unsigned long lastAction{};
             bool timeoutExpired{};
+            SubscriptionOptions options{};
         };
     protected:
         std::unordered_map<std::string, SubscriptionData> subscriptions;
+
+        // exact subscriptions indexed by message type id
+        std::vector<SubscriptionData*> subscriptionsByType;
         std::string buffer;
-        std::list<MessageBatch> pendingItems;
-        MessageBatch currentItem{};
+        BoundedQueue<SharedMessageBatch> pendingItems{DEFAULT_SUBSCRIBER_QUEUE_DEPTH};
+        MessageBatchCursor currentItem{};
+
+        // what was thrown away because the subscriber could not keep up
+        size_t nbDroppedBatches{};
+        size_t nbDroppedMessages{};
+        size_t nbConflatedBatches{};
+
+        // zero copy sends read from the batch until the kernel notifies us, so the batch is kept alive until then
+        size_t zeroCopyThreshold{};
+        std::deque<SharedMessageBatch> zeroCopyBatches;
+        bool isZeroCopySend{false};
+
+        // a subscriber that fell behind gets its queued batches in one sendmsg. The batches after the current one that
+        // are part of that send are moved out of pendingItems, so pendingItems only holds batches that can be dropped.
+        std::vector<iovec> sendVectors;
+        msghdr sendMsg{};
+        std::deque<SharedMessageBatch> gatheredItems;
+
+        // batches of blocking subscriptions that came while pendingItems was full, retained messages and replays are
+        // pushed without the server holding them back. They move to pendingItems, in order, as it drains.
+        std::deque<SharedMessageBatch> overflowItems;
+
+        // set when the subscriber is disconnected while a send is in flight, the socket is closed once the kernel is
+        // done with the send and with every zero copy buffer
+        bool isDisconnectPending{false};
+        SubscriptionIndex* subscriptionIndex{nullptr};
+        RetainedMessages* retainedMessages{nullptr};
+        std::mutex mPostedSubscriptions;
+        std::vector<PendingSubscription> postedSubscriptions;
+        std::vector<ReplayRequest> postedReplays;
+        std::atomic_flag hasPostedSubscriptions{false};
+
+        // wakes the owning loop once something is posted, set by that loop while other threads may already post
+        std::atomic<EventSignal*> postSignal{nullptr};
         bool isNew{true};
     public:
         TCPSubscriberHandler(int res, ServerContext* serverContext)
@@ -30,6 +75,66 @@ namespace gazellemq::server {
             this->serverContext = serverContext;
         }
 
+        void setSubscriptionIndex(SubscriptionIndex* subscriptionIndex) {
+            this->subscriptionIndex = subscriptionIndex;
+        }
+
+        void setRetainedMessages(RetainedMessages* retainedMessages) {
+            this->retainedMessages = retainedMessages;
+        }
+
+        void setPostSignal(EventSignal* value) {
+            this->postSignal.store(value, std::memory_order_release);
+        }
+
+        /**
+         * Sends of at least this many bytes use zero copy, 0 turns zero copy sends off
+         * @param value
+         */
+        void setZeroCopyThreshold(size_t value) {
+            zeroCopyThreshold = value;
+        }
+
+        /**
+         * Sets how many batches can wait to be sent before the slow consumer policy kicks in. Must be set before any
+         * batch is pushed.
+         * @param depth
+         */
+        void setQueueDepth(size_t depth) {
+            pendingItems = BoundedQueue<SharedMessageBatch>{depth};
+        }
+
+        [[nodiscard]] size_t getNbDroppedBatches() const {
+            return nbDroppedBatches;
+        }
+
+        [[nodiscard]] size_t getNbDroppedMessages() const {
+            return nbDroppedMessages;
+        }
+
+        [[nodiscard]] size_t getNbConflatedBatches() const {
+            return nbConflatedBatches;
+        }
+
+        void handleCompletion(io_uring *ring, io_uring_cqe const* cqe) override {
+            if (cqe->flags & IORING_CQE_F_NOTIF) {
+                // the kernel is done reading the batch
+                zeroCopyBatches.pop_front();
+                finishPendingDisconnect(ring);
+                return;
+            }
+
+            if (isZeroCopySend) {
+                isZeroCopySend = false;
+                if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                    // no notification follows a failed zero copy send
+                    zeroCopyBatches.pop_front();
+                }
+            }
+
+            PubSubHandler::handleCompletion(ring, cqe);
+        }
+
         void printHello() override {
             std::cout << clientName << " | a subscriber has connected" << std::endl << std::flush;
         }
@@ -42,15 +147,98 @@ namespace gazellemq::server {
             isNew = b;
         }
     protected:
-        void updateLastAction(std::string const& messageType) {
-            if (subscriptions.contains(messageType)) {
-                subscriptions.at(messageType).lastAction = nowToLong();
+        void updateLastAction(MessageTypeId messageType) {
+            if (messageType < subscriptionsByType.size() && subscriptionsByType[messageType] != nullptr) {
+                subscriptionsByType[messageType]->lastAction = nowToLong();
             }
         }
 
+        /**
+         * Points the message type id of the subscription at its data
+         * @param subscription
+         * @param subscriptionData
+         */
+        void setSubscriptionByType(std::string const& subscription, SubscriptionData* subscriptionData) {
+            MessageTypeId const messageType{getMessageTypes().intern(subscription)};
+            if (messageType >= subscriptionsByType.size()) {
+                subscriptionsByType.resize(messageType + 1, nullptr);
+            }
+            subscriptionsByType[messageType] = subscriptionData;
+        }
+
         void onDisconnected (int res) override {
             std::cout << "Subscriber disconnected [" << clientName << "]\n";
+            if (nbDroppedBatches > 0) {
+                std::cout << "[" << clientName << "] dropped " << nbDroppedBatches << " batches, " << nbDroppedMessages << " messages\n";
+            }
             setDisconnected();
+            removeAllSubscriptions();
+            pendingItems.clear();
+            overflowItems.clear();
+        }
+
+        /**
+         * Returns the slow consumer policy of the subscription to this message type. Message types matched by a
+         * prefix of a subscription use the server default.
+         * @param messageType
+         * @return
+         */
+        [[nodiscard]] Enums::SlowConsumerPolicy getPolicy(MessageTypeId messageType) const {
+            if (messageType < subscriptionsByType.size() && subscriptionsByType[messageType] != nullptr) {
+                return subscriptionsByType[messageType]->options.policy;
+            }
+            return serverContext->getDefaultSlowConsumerPolicy();
+        }
+
+        /**
+         * Returns true if the subscription to this message type only wants the latest batch
+         * @param messageType
+         * @return
+         */
+        [[nodiscard]] bool isConflating(MessageTypeId messageType) const {
+            return messageType < subscriptionsByType.size()
+                && subscriptionsByType[messageType] != nullptr
+                && subscriptionsByType[messageType]->options.conflate;
+        }
+
+        /**
+         * Replaces the waiting batch of the same message type, if there is one
+         * @param batch
+         * @return true if the batch took the place of an older one
+         */
+        bool conflate(SharedMessageBatch const& batch) {
+            for (size_t i{}; i < pendingItems.size(); ++i) {
+                SharedMessageBatch& pendingItem{pendingItems[i]};
+                if (pendingItem->getMessageType() == batch->getMessageType()) {
+                    pendingItem = batch;
+                    ++nbConflatedBatches;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Counts a batch that will never be sent
+         * @param batch
+         */
+        void dropBatch(SharedMessageBatch const& batch) {
+            if (nbDroppedBatches == 0) {
+                std::cout << "[" << clientName << "] is not keeping up, dropping messages" << std::endl;
+            }
+            ++nbDroppedBatches;
+            nbDroppedMessages += batch->getNbMessages();
+        }
+
+        /**
+         * Removes every subscription, so the subscriber no longer receives messages
+         */
+        void removeAllSubscriptions() {
+            for (auto const& [subscription, subscriptionData] : subscriptions) {
+                subscriptionIndex->remove(this, subscription);
+            }
+            subscriptions.clear();
+            subscriptionsByType.clear();
         }
     public:
         /**
@@ -69,31 +257,24 @@ namespace gazellemq::server {
 
             if (anyTimedOut) {
                 std::erase_if(subscriptions, [&](auto& item) {
+                    if (item.second.timeoutExpired) {
+                        subscriptionIndex->remove(this, item.first);
+                        setSubscriptionByType(item.first, nullptr);
+                    }
                     return item.second.timeoutExpired;
                 });
             }
         }
 
-        /**
-         * Returns true if the passed in string is subscribed to by this subscriber.
-         * @param messageType
-         * @return
-         */
-        [[nodiscard]] bool isSubscribed(std::string_view messageType) const {
-            return std::ranges::any_of(subscriptions, [messageType](auto const& o) {
-                return !o.second.timeoutExpired && o.first.starts_with(messageType);
-            });
-        }
-
         void afterSendAckComplete(io_uring *ring) override {
-            memset(readBuffer, 0, MAX_READ_BUF);
+            memset(readBuffer, 0, MAX_HANDSHAKE_BUF);
             buffer.clear();
 
             event = Enums::Event_Ready;
 
             // look for pending subscriptions
             for (auto const& subscription : serverContext->takePendingSubscriptions(clientName)) {
-                addSubscriptions(subscription.timeoutMs, subscription.subscription);
+                addSubscriptions(ring, subscription.timeoutMs, subscription.subscription, subscription.options);
             }
         }
 
@@ -110,13 +291,17 @@ namespace gazellemq::server {
         }
 
         /**
-         * Adds subscriptions to the list, but only ones that do not already exist
+         * Adds subscriptions to the list, but only ones that do not already exist, then sends the retained messages
+         * the new subscriptions match
+         * @param ring
          * @param timeoutMs
          * @param subscriptionsCsv
+         * @param options
          */
-        void addSubscriptions(unsigned long timeoutMs, std::string const& subscriptionsCsv) {
+        void addSubscriptions(io_uring *ring, unsigned long timeoutMs, std::string const& subscriptionsCsv, SubscriptionOptions const& options) {
             std::vector<std::string> subscriptionValues;
             utils::split(std::string(subscriptionsCsv), subscriptionValues);
+            std::vector<std::string> addedValues;
 
             // add each subscription that does not already exist
             for (std::string const& subscriptionValue : subscriptionValues) {
@@ -124,52 +309,291 @@ namespace gazellemq::server {
                     return o.first == subscriptionValue;
                 })) {
                     std::cout << "[" << clientName << "] adding subscription | " << subscriptionValue << std::endl << std::flush;
-                    subscriptions[subscriptionValue] = SubscriptionData{timeoutMs, nowToLong()};
+                    SubscriptionData& subscriptionData{subscriptions[subscriptionValue]};
+                    subscriptionData = SubscriptionData{timeoutMs, nowToLong(), false, options};
+                    setSubscriptionByType(subscriptionValue, &subscriptionData);
+                    subscriptionIndex->add(this, subscriptionValue);
+                    addedValues.push_back(subscriptionValue);
+                }
+            }
+
+            sendRetainedMessages(ring, addedValues);
+        }
+
+        /**
+         * Sends the retained message of every message type that the added subscriptions match and the other
+         * subscriptions did not already match
+         * @param ring
+         * @param addedValues
+         */
+        void sendRetainedMessages(io_uring *ring, std::vector<std::string> const& addedValues) {
+            if (retainedMessages == nullptr || addedValues.empty()) {
+                return;
+            }
+
+            retainedMessages->forEachMessageType([&](MessageTypeId messageType) {
+                std::string const& messageTypeName{getMessageTypes().getName(messageType)};
+                bool const isMatched{std::ranges::any_of(addedValues, [&](std::string const& o) {
+                    return o.starts_with(messageTypeName);
+                })};
+                bool const wasMatched{std::ranges::any_of(subscriptions, [&](auto const& o) {
+                    return o.first.starts_with(messageTypeName) && std::ranges::find(addedValues, o.first) == addedValues.end();
+                })};
+
+                if (isMatched && !wasMatched) {
+                    pushMessageBatch(ring, retainedMessages->get(messageType));
                 }
+            });
+        }
+
+        /**
+         * Queues subscriptions to be added by the thread that owns this subscriber. Safe to call from any thread.
+         * @param timeoutMs
+         * @param subscriptionsCsv
+         * @param options
+         */
+        void postSubscriptions(unsigned long timeoutMs, std::string const& subscriptionsCsv, SubscriptionOptions const& options) {
+            std::lock_guard lock{mPostedSubscriptions};
+            postedSubscriptions.emplace_back(clientName, subscriptionsCsv, timeoutMs, options);
+            hasPostedSubscriptions.test_and_set();
+            notifyPosted();
+        }
+
+        /**
+         * Queues a replay from the message log, to be sent by the thread that owns this subscriber. Safe to call from
+         * any thread.
+         * @param request
+         */
+        void postReplay(ReplayRequest&& request) {
+            std::lock_guard lock{mPostedSubscriptions};
+            postedReplays.push_back(std::move(request));
+            hasPostedSubscriptions.test_and_set();
+            notifyPosted();
+        }
+
+        /**
+         * Wakes the owning loop, so what was posted is applied without waiting for its next timeout
+         */
+        void notifyPosted() const {
+            if (EventSignal* signal{postSignal.load(std::memory_order_acquire)}) {
+                signal->notify();
             }
         }
 
         /**
-         * Sends the data to the subscriber, or queues it to be sent later.
+         * Adds the subscriptions and sends the replays that were posted from other threads
+         * @param ring
+         */
+        void applyPostedSubscriptions(io_uring *ring) {
+            if (!hasPostedSubscriptions.test()) {
+                return;
+            }
+
+            std::vector<PendingSubscription> posted;
+            std::vector<ReplayRequest> replays;
+            {
+                std::lock_guard lock{mPostedSubscriptions};
+                posted.swap(postedSubscriptions);
+                replays.swap(postedReplays);
+                hasPostedSubscriptions.clear();
+            }
+
+            for (PendingSubscription const& subscription : posted) {
+                addSubscriptions(ring, subscription.timeoutMs, subscription.subscription, subscription.options);
+            }
+
+            for (ReplayRequest const& replay : replays) {
+                sendReplay(ring, replay);
+            }
+        }
+
+        /**
+         * Queues the logged batches of the replay. They are sent from the log's mapped pages, as they were written.
+         * @param ring
+         * @param replay
+         */
+        void sendReplay(io_uring *ring, ReplayRequest const& replay) {
+            MessageLog* messageLog{serverContext->getMessageLog()};
+            if (messageLog == nullptr) {
+                std::cerr << "[" << clientName << "] cannot replay " << replay.topic << ", the message log is off" << std::endl;
+                return;
+            }
+
+            std::cout << "[" << clientName << "] replaying | " << replay.topic << " from " << (replay.isTimestamp ? "time " : "offset ") << replay.from << std::endl;
+            for (SharedMessageBatch const& batch : messageLog->read(replay)) {
+                pushMessageBatch(ring, batch);
+            }
+        }
+
+        /**
+         * Returns true if the batch cannot be queued yet because the send queue is full and the subscription asks to
+         * block. The server holds the batch back until this returns false.
+         * @param messageType
+         * @return
+         */
+        [[nodiscard]] bool isBlocking(MessageTypeId messageType) const {
+            return event != Enums::Event_Disconnected
+                && (pendingItems.full() || !overflowItems.empty())
+                && getPolicy(messageType) == Enums::SlowConsumer_Block;
+        }
+
+        /**
+         * Sends the data to the subscriber, or queues it to be sent later. Only a reference to the batch is kept. When
+         * the queue is full the subscription's slow consumer policy decides what happens. A conflating subscription
+         * replaces its waiting batch instead of queueing another one.
          * @param ring
          * @param batch
          */
-        void pushMessageBatch(io_uring *ring, MessageBatch const& batch) {
-            updateLastAction(batch.getMessageType());
+        void pushMessageBatch(io_uring *ring, SharedMessageBatch const& batch) {
+            if (event == Enums::Event_Disconnected || isDisconnectPending) {
+                return;
+            }
+
+            updateLastAction(batch->getMessageType());
 
             if (!currentItem.hasContent()) {
-                currentItem.copy(batch);
+                currentItem = MessageBatchCursor{batch};
                 sendCurrentMessage(ring);
-            } else {
-                pendingItems.push_back(batch.copy());
+                return;
             }
+
+            if (isConflating(batch->getMessageType()) && conflate(batch)) {
+                return;
+            }
+
+            Enums::SlowConsumerPolicy const policy{getPolicy(batch->getMessageType())};
+            if (policy == Enums::SlowConsumer_Block && !overflowItems.empty()) {
+                overflowItems.push_back(batch);
+                return;
+            }
+
+            if (pendingItems.full()) {
+                switch (policy) {
+                    case Enums::SlowConsumer_DropNewest:
+                        dropBatch(batch);
+                        return;
+                    case Enums::SlowConsumer_Disconnect:
+                        // the queue is only full while a send is in flight, the socket is closed once it completes
+                        std::cout << "[" << clientName << "] send queue is full, disconnecting" << std::endl;
+                        isDisconnectPending = true;
+                        pendingItems.clear();
+                        return;
+                    case Enums::SlowConsumer_Block:
+                        // only retained messages and replays get here, the server holds other batches back while
+                        // isBlocking(). Nothing is dropped, the queue goes over its depth until it drains.
+                        overflowItems.push_back(batch);
+                        return;
+                    case Enums::SlowConsumer_DropOldest:
+                        dropBatch(pendingItems.front());
+                        pendingItems.pop_front();
+                        break;
+                }
+            }
+
+            pendingItems.push_back(batch);
         }
 
         /**
-         * Sends the pending batch of messages
-         * @param ring
+         * Moves the batches that went over the send queue's depth into it, as far as there is room
          */
-        void sendNextPendingMessageBatch(io_uring *ring) {
-            currentItem = std::move(pendingItems.front());
-            pendingItems.pop_front();
+        void takeOverflowItems() {
+            while (!overflowItems.empty() && !pendingItems.full()) {
+                pendingItems.push_back(std::move(overflowItems.front()));
+                overflowItems.pop_front();
+            }
+        }
 
-            if (currentItem.hasContent()) {
-                currentItem.setBusy();
-                sendCurrentMessage(ring);
+        /**
+         * Points [sendMsg] at the rest of the current batch, the batches gathered by the previous send, and as many
+         * pending batches as fit in IOV_MAX vectors and MAX_GATHER_BYTES
+         */
+        void prepareSendVectors() {
+            sendVectors.clear();
+            sendVectors.push_back({const_cast<char*>(currentItem.getBufferRemaining()), currentItem.getBufferLength()});
+
+            size_t nbBytes{currentItem.getBufferLength()};
+            for (SharedMessageBatch const& batch : gatheredItems) {
+                sendVectors.push_back({const_cast<char*>(batch->getBuffer()), batch->getBufferLength()});
+                nbBytes += batch->getBufferLength();
             }
+
+            while (!pendingItems.empty()) {
+                SharedMessageBatch& batch{pendingItems.front()};
+                if (sendVectors.size() == IOV_MAX || nbBytes + batch->getBufferLength() > MAX_GATHER_BYTES) {
+                    break;
+                }
+
+                sendVectors.push_back({const_cast<char*>(batch->getBuffer()), batch->getBufferLength()});
+                nbBytes += batch->getBufferLength();
+                gatheredItems.push_back(std::move(batch));
+                pendingItems.pop_front();
+            }
+
+            sendMsg = msghdr{};
+            sendMsg.msg_iov = sendVectors.data();
+            sendMsg.msg_iovlen = sendVectors.size();
         }
 
         /**
-         * Sends the remaining bytes to the endpoint
+         * Moves the send position forward by the number of bytes sent, across as many batches as it covers
+         * @param nbBytes
+         */
+        void advanceSent(size_t nbBytes) {
+            while (true) {
+                size_t const n{std::min(nbBytes, currentItem.getBufferLength())};
+                currentItem.advance(n);
+                nbBytes -= n;
+
+                if (!currentItem.getIsDone()) {
+                    return;
+                }
+
+                if (gatheredItems.empty()) {
+                    currentItem.reset();
+                    return;
+                }
+
+                currentItem = MessageBatchCursor{std::move(gatheredItems.front())};
+                gatheredItems.pop_front();
+
+                if (nbBytes == 0) {
+                    return;
+                }
+            }
+        }
+
+        /**
+         * Sends the remaining bytes to the endpoint, along with the pending batches if there are any
          * @param ring
          */
         void sendCurrentMessage(io_uring *ring) {
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
-            io_uring_prep_send(sqe, fd, currentItem.getBufferRemaining(), currentItem.getBufferLength(), 0);
+            io_uring_sqe* sqe = getSqe(ring);
+            if (!pendingItems.empty() || !gatheredItems.empty()) {
+                prepareSendVectors();
+                io_uring_prep_sendmsg(sqe, fd, &sendMsg, 0);
+            } else if (zeroCopyThreshold > 0 && currentItem.getBufferLength() >= zeroCopyThreshold) {
+                io_uring_prep_send_zc(sqe, fd, currentItem.getBufferRemaining(), currentItem.getBufferLength(), 0, 0);
+                zeroCopyBatches.push_back(currentItem.getBatch());
+                isZeroCopySend = true;
+            } else {
+                io_uring_prep_send(sqe, fd, currentItem.getBufferRemaining(), currentItem.getBufferLength(), 0);
+            }
+            setFdFlags(sqe);
 
             event = Enums::Event_SendData;
             io_uring_sqe_set_data(sqe, this);
-            io_uring_submit(ring);
+        }
+
+        /**
+         * Closes the socket of a subscriber that was disconnected while a send was in flight, once the kernel no longer
+         * uses any of its buffers
+         * @param ring
+         */
+        void finishPendingDisconnect(io_uring *ring) {
+            if (isDisconnectPending && event != Enums::Event_SendData && zeroCopyBatches.empty()) {
+                isDisconnectPending = false;
+                beginDisconnect(ring);
+            }
         }
 
         /**
@@ -179,21 +603,23 @@ namespace gazellemq::server {
          * @return
          */
         void onSendCurrentMessageComplete(io_uring *ring, const int res) {
-            if (res == 0) {
+            if (isDisconnectPending) {
+                // nothing else is sent
+                event = Enums::Event_Ready;
+                finishPendingDisconnect(ring);
+            } else if (res == 0) {
                 // do nothing here
                 std::cout << "possible disconnected subscriber\n";
             } else if (res > -1) {
-                currentItem.advance(res);
-                if (currentItem.getIsDone()) {
-                    currentItem.clearForNextMessage();
+                advanceSent(res);
+                takeOverflowItems();
+                if (currentItem.getIsDone() && !pendingItems.empty()) {
+                    currentItem = MessageBatchCursor{std::move(pendingItems.front())};
+                    pendingItems.pop_front();
+                    sendCurrentMessage(ring);
+                } else if (currentItem.getIsDone()) {
                     // To get here means we've sent all the data
-
-                    // collect the next messages
-                    if (!pendingItems.empty()) {
-                        sendNextPendingMessageBatch(ring);
-                    } else {
-                        event = Enums::Event_Ready;
-                    }
+                    event = Enums::Event_Ready;
                 } else {
                     sendCurrentMessage(ring);
                 }
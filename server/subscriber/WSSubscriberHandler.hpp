@@ -21,23 +21,19 @@ namespace gazellemq::server {
         void onDisconnected (int res) override {
             std::cout << "WebSocket disconnected [" << clientName << "]\n";
             setDisconnected();
+            removeAllSubscriptions();
         }
 
 
         /**
-         * This client must now indicate whether it is a publisher or subscriber
+         * The connection was accepted, WebSocket clients start with an http upgrade
          * @param ring
-         * @param res
          */
-        void onMakeNonblockingSocketComplete(struct io_uring* ring, int res) override {
-            if (res < 0) {
-                printError(__PRETTY_FUNCTION__ , res);
-                beginDisconnect(ring);
-            } else {
+        void onConnected(struct io_uring* ring) override {
+            setIsNew(false);
 
-                // client must communicate with server
-                this->beginReceiveHttpUpgrade(ring);
-            }
+            // client must communicate with server
+            this->beginReceiveHttpUpgrade(ring);
         }
 
         /**
@@ -45,13 +41,13 @@ namespace gazellemq::server {
          * @param ring
          */
         void beginReceiveHttpUpgrade(struct io_uring* ring) {
-            memset(readBuffer, 0, MAX_READ_BUF);
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
+            memset(readBuffer, 0, MAX_HANDSHAKE_BUF);
+            io_uring_sqe* sqe = getSqe(ring);
             io_uring_prep_recv(sqe, fd, readBuffer, 2, 0);
+            setFdFlags(sqe);
             io_uring_sqe_set_data(sqe, this);
 
             event = Enums::Event::Event_ReceiveHttpUpgrade;
-            io_uring_submit(ring);
         }
 
         void onReceiveHttpUpgradeComplete(struct io_uring* ring, int const res) {
@@ -64,7 +60,7 @@ namespace gazellemq::server {
                 char* dest{};
                 size_t destLen;
                 auto result{webResponseParser.parse(readBuffer, res, dest, destLen)};
-                memset(readBuffer, 0, MAX_READ_BUF);
+                memset(readBuffer, 0, MAX_HANDSHAKE_BUF);
 
                 switch (result) {
                     case V_SUCCEEDED:
@@ -110,12 +106,12 @@ namespace gazellemq::server {
         }
 
         void beginSendWSResponse(struct io_uring* ring) {
-            io_uring_sqe* sqe = io_uring_get_sqe(ring);
+            io_uring_sqe* sqe = getSqe(ring);
             io_uring_prep_send(sqe, fd, &wsHandshakeWriteBuffer[handshakeOffset], handshakeLength - handshakeOffset, 0);
+            setFdFlags(sqe);
             io_uring_sqe_set_data(sqe, this);
 
             event = Enums::Event::Event_SendWSHandshake;
-            io_uring_submit(ring);
         }
 
         void onSendWSResponseComplete(struct io_uring* ring, int const res) {
@@ -139,10 +135,7 @@ namespace gazellemq::server {
 
             switch (event) {
                 case Enums::Event::Event_NotSet:
-                    beginMakeNonblockingSocket(ring, res);
-                    break;
-                case Enums::Event::Event_SetNonblockingPublisher:
-                    onMakeNonblockingSocketComplete(ring, res);
+                    onConnected(ring);
                     break;
                 case Enums::Event::Event_ReceiveHttpUpgrade:
                     onReceiveHttpUpgradeComplete(ring, res);